@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+#include "../linq.h"
+
+using namespace linq;
+
+// Results are written here so the optimizer can't drop the loops being measured
+volatile size_t sink = 0;
+
+template<typename Func>
+void runCase(bench::perf_counters& counters, const std::string& name, size_t elements, Func func) {
+    // Warm up caches and the allocator before measuring
+    sink = sink + func();
+
+    auto start = std::chrono::steady_clock::now();
+    counters.start();
+    sink = sink + func();
+    bench::counter_values values = counters.stop();
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+        << std::setw(12) << static_cast<double>(elapsed.count()) / elements;
+    for (size_t i = 0; i < bench::counterCount; i++) {
+        bench::counter c = static_cast<bench::counter>(i);
+        if (values.has(c)) std::cout << std::setw(16) << values[c] / elements;
+        else std::cout << std::setw(16) << "n/a";
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t elements = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1 << 20);
+
+    std::mt19937 random(42);
+    std::vector<int> values(elements);
+    std::vector<int> keys(elements);
+    for (size_t i = 0; i < elements; i++) {
+        values[i] = static_cast<int>(random());
+        keys[i] = static_cast<int>(random() % 1024);
+    }
+    // Posting lists, each id is in a list with probability one half
+    std::vector<uint32_t> posting1;
+    std::vector<uint32_t> posting2;
+    for (uint32_t id = 0; id < 2 * elements; id++) {
+        if (random() & 1) posting1.push_back(id);
+        if (random() & 1) posting2.push_back(id);
+    }
+
+    // Short inner ranges so the per range work shows up
+    std::vector<std::vector<int>> nested;
+    for (size_t i = 0; i < elements; i += 8) nested.emplace_back(values.begin() + i, values.begin() + std::min(elements, i + 8));
+
+    // Opened before any case so the threads of the default pool inherit them
+    bench::perf_counters counters;
+    if (!counters.available()) {
+        std::cerr << "Hardware counters unavailable (check /proc/sys/kernel/perf_event_paranoid), reporting wall time only\n";
+    }
+
+    std::cout << "Per element, " << elements << " elements\n";
+    std::cout << std::left << std::setw(24) << "case" << std::right << std::setw(12) << "ns";
+    for (size_t i = 0; i < bench::counterCount; i++) {
+        std::cout << std::setw(16) << bench::counterName(static_cast<bench::counter>(i));
+    }
+    std::cout << "\n";
+
+    runCase(counters, "vector baseline", elements, [&values]() {
+        size_t sum = 0;
+        for (int value : values) sum += value;
+        return sum;
+    });
+
+    // Every step goes through iterator_wrapper's virtual dispatch
+    runCase(counters, "from", elements, [&values]() {
+        size_t sum = 0;
+        for (int value : from(values)) sum += value;
+        return sum;
+    });
+
+    runCase(counters, "filter", elements, [&values]() {
+        size_t sum = 0;
+        for (int value : from(values).filter([](const int& v) { return v % 2 == 0; })) sum += value;
+        return sum;
+    });
+
+    runCase(counters, "select", elements, [&values]() {
+        size_t sum = 0;
+        for (long long value : from(values).select([](const int& v) { return static_cast<long long>(v) * 3; })) sum += value;
+        return sum;
+    });
+
+    // Node based std::set in distinct_iterator
+    runCase(counters, "distinct", elements, [&keys]() {
+        size_t count = 0;
+        for (int value : from(keys).distinct()) count += value;
+        return count;
+    });
+
+    // Node based std::map in group_iterator
+    runCase(counters, "group", elements, [&keys]() {
+        size_t count = 0;
+        auto grouped = linq::group(keys, [](const int& v) { return v % 64; }, [](const std::vector<int>& group) { return group.size(); });
+        for (size_t size : grouped) count += size;
+        return count;
+    });
+
+    // Pointer chasing through PairingHeap
+    runCase(counters, "orderBy", elements, [&values]() {
+        size_t sum = 0;
+        for (int value : from(values).orderBy()) sum += value;
+        return sum;
+    });
+
+    // One virtual step per row through flatten_iterator
+    runCase(counters, "flatten iterate", elements, [&nested]() {
+        size_t sum = 0;
+        for (int value : from(nested).flatten()) sum += value;
+        return sum;
+    });
+
+    // Tight loop over each inner range
+    runCase(counters, "flatten aggregate", elements, [&nested]() {
+        return from(nested).flatten().aggregate(size_t{ 0 }, [](size_t sum, const int& v) { return sum + v; });
+    });
+
+    // One flat list of ranges instead of nested concats
+    runCase(counters, "concatAll iterate", elements, [&nested]() {
+        size_t sum = 0;
+        for (int value : concatAll(nested)) sum += value;
+        return sum;
+    });
+
+    // Rolling max over a ring buffer, O(1) amortized per slide
+    runCase(counters, "window max", elements, [&values]() {
+        size_t sum = 0;
+        from(values).window(64).forEach([&sum](const window_view<int>& w) { sum += w.max(); });
+        return sum;
+    });
+
+    // Running balance, sequential and reduce then scan on the default pool
+    runCase(counters, "scan", elements, [&values]() {
+        size_t last = 0;
+        for (long long balance : from(values).scan(0LL, [](long long sum, const int& v) { return sum + v; })) last = balance;
+        return last;
+    });
+
+    runCase(counters, "scan par", elements, [&values]() {
+        size_t last = 0;
+        auto running = from(values).scan(par, 0LL, [](long long sum, const int& v) { return sum + v; }, [](long long a, long long b) { return a + b; });
+        for (long long balance : running) last = balance;
+        return last;
+    });
+
+    // Geometric skips jump over the rows that aren't picked
+    runCase(counters, "sampleBernoulli 0.1%", elements, [&values]() {
+        size_t sum = 0;
+        for (int value : from(values).sampleBernoulli(0.001, 42)) sum += value;
+        return sum;
+    });
+
+    runCase(counters, "sampleReservoir 1000", elements, [&values]() {
+        size_t sum = 0;
+        for (int value : from(values).sampleReservoir(1000, 42)) sum += value;
+        return sum;
+    });
+
+    // Fixed 16 KB of registers against distinct's tree of every key
+    runCase(counters, "approxCountDistinct", elements, [&values]() {
+        return from(values).approxCountDistinct();
+    });
+
+    // Block compares in sortedIntersectionCount
+    runCase(counters, "sortedInts intersect", elements, [&posting1, &posting2]() {
+        return sorted_ints(posting1).intersectCount(sorted_ints(posting2));
+    });
+
+    // Scalar merge the block compares are measured against
+    runCase(counters, "scalar merge intersect", elements, [&posting1, &posting2]() {
+        size_t count = 0;
+        auto first = posting1.begin();
+        auto second = posting2.begin();
+        while (first != posting1.end() && second != posting2.end()) {
+            if (*first < *second) ++first;
+            else if (*second < *first) ++second;
+            else {
+                ++count;
+                ++first;
+                ++second;
+            }
+        }
+        return count;
+    });
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__) && !defined(LINQ_NO_PERF_COUNTERS)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define LINQ_HAS_PERF_COUNTERS
+#endif
+
+namespace bench {
+    enum class counter : size_t {
+        cycles,
+        instructions,
+        branchMisses,
+        l1dMisses,
+        llcMisses,
+        dtlbMisses,
+        count
+    };
+
+    constexpr size_t counterCount = static_cast<size_t>(counter::count);
+
+    inline const char* counterName(counter c) {
+        switch (c) {
+        case counter::cycles: return "cycles";
+        case counter::instructions: return "instructions";
+        case counter::branchMisses: return "branch-misses";
+        case counter::l1dMisses: return "L1d-misses";
+        case counter::llcMisses: return "LLC-misses";
+        case counter::dtlbMisses: return "dTLB-misses";
+        default: return "unknown";
+        }
+    }
+
+    struct counter_values {
+        std::array<double, counterCount> values{};
+        // A counter is invalid if the kernel refused to open it or the group never got scheduled on the PMU
+        std::array<bool, counterCount> valid{};
+
+        double operator[](counter c) const {
+            return this->values[static_cast<size_t>(c)];
+        }
+
+        bool has(counter c) const {
+            return this->valid[static_cast<size_t>(c)];
+        }
+    };
+
+    // Hardware counters through perf_event_open, opened as one group so they are always scheduled on the PMU
+    // together and their ratios aren't skewed by multiplexing. The values are still scaled by time enabled over time
+    // running in case the whole group had to share the PMU. The counters are inherited by threads created after
+    // they were opened, so open them before any thread pool starts to have its work counted too. Counters that can't
+    // be opened (no permission, virtualized PMU, not on Linux) are reported as invalid instead of failing the benchmark.
+    class perf_counters {
+    public:
+        perf_counters() {
+            this->fds.fill(-1);
+#ifdef LINQ_HAS_PERF_COUNTERS
+            this->add(counter::cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            this->add(counter::instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            this->add(counter::branchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+            this->add(counter::l1dMisses, PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D));
+            this->add(counter::llcMisses, PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL));
+            this->add(counter::dtlbMisses, PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB));
+#endif
+        }
+
+        perf_counters(const perf_counters&) = delete;
+        perf_counters& operator=(const perf_counters&) = delete;
+
+        ~perf_counters() {
+#ifdef LINQ_HAS_PERF_COUNTERS
+            for (int fd : this->fds) {
+                if (fd >= 0) close(fd);
+            }
+#endif
+        }
+
+        bool available() const {
+            return this->leader >= 0;
+        }
+
+        void start() {
+#ifdef LINQ_HAS_PERF_COUNTERS
+            if (this->leader < 0) return;
+            ioctl(this->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(this->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+        }
+
+        counter_values stop() {
+            counter_values result;
+#ifdef LINQ_HAS_PERF_COUNTERS
+            if (this->leader < 0) return result;
+            ioctl(this->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            // Layout given by PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+            // the values come in the order the counters joined the group
+            std::array<uint64_t, 3 + counterCount> data{};
+            ssize_t expected = static_cast<ssize_t>((3 + this->members) * sizeof(uint64_t));
+            if (read(this->leader, data.data(), sizeof(data)) != expected || data[0] != this->members || data[2] == 0) return result;
+            for (size_t i = 0; i < this->members; i++) {
+                size_t c = static_cast<size_t>(this->order[i]);
+                result.values[c] = static_cast<double>(data[3 + i]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+                result.valid[c] = true;
+            }
+#endif
+            return result;
+        }
+
+    private:
+        std::array<int, counterCount> fds;
+        int leader{ -1 };
+        std::array<counter, counterCount> order{};
+        size_t members{ 0 };
+
+#ifdef LINQ_HAS_PERF_COUNTERS
+        static uint64_t cacheMiss(uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+
+        // The first counter that opens leads the group, the rest are opened into it
+        void add(counter c, uint32_t type, uint64_t config) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            // Only the leader starts disabled, members follow it
+            attr.disabled = this->leader < 0 ? 1 : 0;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, this->leader, 0));
+            if (fd < 0) return;
+            this->fds[static_cast<size_t>(c)] = fd;
+            if (this->leader < 0) this->leader = fd;
+            this->order[this->members++] = c;
+        }
+#endif
+    };
+}
+#endif
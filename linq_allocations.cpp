@@ -0,0 +1,135 @@
+// Replaces the global allocation functions so allocations can be attributed to the running stage. Link this file
+// into a program built with LINQ_INSTRUMENT to fill in stage_stats::allocations and allocatedBytes, it covers the
+// plain, array, aligned and nothrow forms so every new is counted and paired with the matching delete.
+#ifndef LINQ_INSTRUMENT
+#error "linq_allocations.cpp only works together with LINQ_INSTRUMENT"
+#endif
+
+#include <cstdlib>
+#include <new>
+
+#include "linq.h"
+
+namespace {
+	// Alignment of 0 means the default one. Goes through the new handler like the default allocation functions,
+	// null once there is none left to try.
+	void* allocate(std::size_t size, std::size_t alignment) {
+		linq::detail::stage_scope::recordAllocation(size);
+		if (size == 0) size = 1;
+		while (true) {
+#ifdef _MSC_VER
+			void* allocated = alignment ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+			// aligned_alloc wants the size to be a multiple of the alignment
+			void* allocated = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment) : std::malloc(size);
+#endif
+			if (allocated) return allocated;
+			std::new_handler handler = std::get_new_handler();
+			if (!handler) return nullptr;
+			handler();
+		}
+	}
+
+	void* allocateOrThrow(std::size_t size, std::size_t alignment) {
+		if (void* allocated = allocate(size, alignment)) return allocated;
+		throw std::bad_alloc();
+	}
+
+	void* allocateOrNull(std::size_t size, std::size_t alignment) noexcept {
+		try {
+			return allocate(size, alignment);
+		}
+		catch (...) {
+			return nullptr;
+		}
+	}
+
+	void release(void* allocated, bool aligned) noexcept {
+#ifdef _MSC_VER
+		if (aligned) return _aligned_free(allocated);
+#else
+		static_cast<void>(aligned);
+#endif
+		std::free(allocated);
+	}
+}
+
+void* operator new(std::size_t size) {
+	return allocateOrThrow(size, 0);
+}
+
+void* operator new[](std::size_t size) {
+	return allocateOrThrow(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return allocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return allocateOrNull(size, 0);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return allocateOrNull(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return allocateOrNull(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return allocateOrNull(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* allocated) noexcept {
+	release(allocated, false);
+}
+
+void operator delete[](void* allocated) noexcept {
+	release(allocated, false);
+}
+
+void operator delete(void* allocated, std::size_t) noexcept {
+	release(allocated, false);
+}
+
+void operator delete[](void* allocated, std::size_t) noexcept {
+	release(allocated, false);
+}
+
+void operator delete(void* allocated, std::align_val_t) noexcept {
+	release(allocated, true);
+}
+
+void operator delete[](void* allocated, std::align_val_t) noexcept {
+	release(allocated, true);
+}
+
+void operator delete(void* allocated, std::size_t, std::align_val_t) noexcept {
+	release(allocated, true);
+}
+
+void operator delete[](void* allocated, std::size_t, std::align_val_t) noexcept {
+	release(allocated, true);
+}
+
+void operator delete(void* allocated, const std::nothrow_t&) noexcept {
+	release(allocated, false);
+}
+
+void operator delete[](void* allocated, const std::nothrow_t&) noexcept {
+	release(allocated, false);
+}
+
+void operator delete(void* allocated, std::align_val_t, const std::nothrow_t&) noexcept {
+	release(allocated, true);
+}
+
+void operator delete[](void* allocated, std::align_val_t, const std::nothrow_t&) noexcept {
+	release(allocated, true);
+}
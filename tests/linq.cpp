@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
 
 #include "gtest/gtest.h"
 
@@ -55,7 +63,7 @@ namespace {
 			as.push_back(std::make_shared<B<11>>());
 			as.push_back(std::make_shared<B<12>>());
 
-            for(const std::shared_ptr<A> a : as) {
+            for(const std::shared_ptr<A>& a : as) {
                 asPtr.push_back(a.get());
             }
 
@@ -317,11 +325,17 @@ TEST_F(LinqTest, TestFilterOddConst) {
     EXPECT_EQ(count, 6);
 }
 
+TEST_F(LinqTest, TestFilterConstIteratorSkipsRejectedFirst) {
+    using Iter = std::vector<std::shared_ptr<A>>::const_iterator;
+    const linq::filter_iterator<Iter> it(as.cbegin(), as.cend(), [](const std::shared_ptr<A>& a) { return a->test() % 2 == 1; });
+    EXPECT_EQ((*it)->test(), 1);
+}
+
 TEST_F(LinqTest, TestFilterFalse) {
     auto filtered = as_linqed.filter([](const std::shared_ptr<A>&) { return false; });
     // EXPECT_EQ(filtered.count(), 7);
     size_t count = 0;
-    for (const std::shared_ptr<A>& _ : filtered) {
+    for ([[maybe_unused]] const std::shared_ptr<A>& _ : filtered) {
         EXPECT_TRUE(false);
         ++count;
     }
@@ -560,13 +574,28 @@ TEST_F(LinqTest, TestConstConcatIterators) {
 }
 
 TEST_F(LinqTest, TestDistinct) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    std::vector<int> values{ 3, 1, 3, 2, 1, 4, 4 };
+    auto unique = from(values).distinct();
+    EXPECT_EQ(unique.toVector(), (std::vector<int>{ 3, 1, 2, 4 }));
+    EXPECT_EQ(unique.count(), 4);
+    // A copy walks the same rows without redoing the comparisons its original already made
+    auto it = unique.begin();
+    ++it;
+    auto copy = it;
+    ++it;
+    ++it;
+    EXPECT_EQ(*copy, 1);
+    EXPECT_EQ(*it, 4);
+    ++copy;
+    ++copy;
+    EXPECT_TRUE(copy == it);
+    std::vector<int> none;
+    EXPECT_EQ(from(none).distinct().count(), 0);
 }
 
 TEST_F(LinqTest, TestConstDistinct) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    const std::vector<int> values{ 2, 2, 2 };
+    EXPECT_EQ(from(values).distinct().toVector(), (std::vector<int>{ 2 }));
 }
 
 TEST_F(LinqTest, TestSetUnionContainer) {
@@ -650,33 +679,91 @@ TEST_F(LinqTest, TestConstSkipWhile) {
 }
 
 TEST_F(LinqTest, TestFlatten) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    std::vector<std::vector<int>> nested{ {}, { 1, 2 }, {}, {}, { 3 }, { 4, 5, 6 }, {} };
+    auto flat = from(nested).flatten();
+    EXPECT_EQ(flat.toVector(), (std::vector<int>{ 1, 2, 3, 4, 5, 6 }));
+    EXPECT_EQ(flat.count(), 6);
+    EXPECT_EQ(flat.aggregate(0, [](int sum, const int& v) { return sum + v; }), 21);
+    std::vector<int> seen;
+    flat.forEach([&seen](const int& v) { seen.push_back(v); });
+    EXPECT_EQ(seen, (std::vector<int>{ 1, 2, 3, 4, 5, 6 }));
+    // Rows are the inner containers' own elements, nothing is copied
+    EXPECT_EQ(&*flat.begin(), &nested[1][0]);
+    EXPECT_EQ(flat.filter([](const int& v) { return v % 2 == 0; }).toVector(), (std::vector<int>{ 2, 4, 6 }));
+
+    std::vector<std::vector<int>> empty{ {}, {} };
+    EXPECT_EQ(from(empty).flatten().count(), 0);
+    EXPECT_TRUE(from(empty).flatten().begin() == from(empty).flatten().end());
+    EXPECT_EQ(from(nested).flatten().explain().find("flatten"), 0);
 }
 
 TEST_F(LinqTest, TestConstFlatten) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    const std::vector<std::vector<int>> nested{ { 1 }, {}, { 2, 3 } };
+    const auto flat = from(nested).flatten();
+    EXPECT_EQ(flat.toVector(), (std::vector<int>{ 1, 2, 3 }));
+    EXPECT_EQ(flat.count(), 3);
 }
 
 TEST_F(LinqTest, TestSelectMany) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    std::vector<int> values{ 3, 0, 2 };
+    auto repeated = from(values).selectMany([](const int& v) { return std::vector<int>(v, v); });
+    EXPECT_EQ(repeated.toVector(), (std::vector<int>{ 3, 3, 3, 2, 2 }));
+    EXPECT_EQ(repeated.count(), 5);
+    EXPECT_EQ(repeated.aggregate(0, [](int sum, const int& v) { return sum + v; }), 13);
+    // Copies of an iterator keep walking their own copy of the inner range
+    auto it = repeated.begin();
+    ++it;
+    auto copy = it;
+    ++it;
+    ++it;
+    EXPECT_EQ(*copy, 3);
+    EXPECT_EQ(*it, 2);
+    ++copy;
+    ++copy;
+    EXPECT_TRUE(copy == it);
+
+    std::vector<std::string> words{ "ab", "", "cde" };
+    auto letters = from(words).selectMany([](const std::string& word) { return word; });
+    EXPECT_EQ(letters.toVector(), (std::vector<char>{ 'a', 'b', 'c', 'd', 'e' }));
+    EXPECT_EQ(letters.explain().find("selectMany(fn)"), 0);
 }
 
 TEST_F(LinqTest, TestConstSelectMany) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    const std::vector<int> values{ 1, 2 };
+    const auto repeated = from(values).selectMany([](const int& v) { return std::vector<int>(v, v); });
+    EXPECT_EQ(repeated.toVector(), (std::vector<int>{ 1, 2, 2 }));
 }
 
 TEST_F(LinqTest, TestGroup) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    std::vector<int> values{ 5, 2, 7, 4, 10, 1 };
+    auto sums = linq::group(values, [](const int& v) { return v % 3; }, [](const std::vector<int>& group) {
+        return from(group).aggregate(0, [](int sum, const int& v) { return sum + v; });
+    });
+    // Groups come out in the order their keys first show up
+    EXPECT_EQ(sums.toVector(), (std::vector<int>{ 7, 22 }));
+    EXPECT_EQ(sums.count(), 2);
+    EXPECT_EQ(sums.take(1).toVector(), (std::vector<int>{ 7 }));
+    EXPECT_EQ(sums.skip(1).toVector(), (std::vector<int>{ 22 }));
+    std::vector<int> none;
+    EXPECT_EQ(linq::group(none, [](const int& v) { return v; }, [](const std::vector<int>& group) { return group.size(); }).count(), 0);
+}
+
+TEST_F(LinqTest, TestGroupOncePerStage) {
+    std::vector<int> values{ 5, 2, 7, 4, 10, 1 };
+    size_t keyed = 0;
+    auto sizes = linq::group(values, [&keyed](const int& v) { keyed++; return v % 3; }, [](const std::vector<int>& group) { return group.size(); });
+    EXPECT_EQ(sizes.toVector(), (std::vector<size_t>{ 2, 4 }));
+    EXPECT_EQ(sizes.count(), 2);
+    EXPECT_EQ(sizes.take(1).toVector(), (std::vector<size_t>{ 2 }));
+    EXPECT_EQ(sizes.skip(1).toVector(), (std::vector<size_t>{ 4 }));
+    // Every begin() reads the groups the first one built
+    EXPECT_EQ(keyed, values.size());
 }
 
 TEST_F(LinqTest, TestConstGroup) {
-    // CodeReview: Implement
-    GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
+    const std::vector<int> values{ 1, 2, 3, 4 };
+    auto sizes = linq::group(values, [](const int& v) { return v % 2; }, [](const std::vector<int>& group) { return group.size(); });
+    EXPECT_EQ(sizes.toVector(), (std::vector<size_t>{ 2, 2 }));
 }
 
 TEST_F(LinqTest, TestJoinContainer) {
@@ -738,3 +825,1254 @@ TEST_F(LinqTest, TestConstZipIterators) {
     // CodeReview: Implement
     GTEST_WARN << "Test not implemented. Number " << testCount++ << "\n";
 }
+
+#ifdef LINQ_INSTRUMENT
+TEST_F(LinqTest, TestStatsFilter) {
+    auto filtered = as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; });
+    size_t count = 0;
+    for (const std::shared_ptr<A>& a : filtered) {
+        EXPECT_EQ(a->test() % 2, 0);
+        ++count;
+    }
+    pipeline_stats stats = filtered.stats();
+    ASSERT_EQ(stats.size(), 2);
+    EXPECT_STREQ(stats[0].kind, "id");
+    EXPECT_STREQ(stats[1].kind, "filter");
+    EXPECT_EQ(stats[1].produced, count);
+    EXPECT_EQ(stats[1].consumed, stats[0].produced);
+    EXPECT_GE(stats[1].invocations, as.size());
+}
+
+TEST_F(LinqTest, TestStatsSelect) {
+    auto selected = as_linqed.select([](const std::shared_ptr<A>& a) { return a->test(); });
+    int count = 0;
+    for (const int& a : selected) {
+        EXPECT_EQ(a, count);
+        ++count;
+    }
+    pipeline_stats stats = selected.stats();
+    ASSERT_EQ(stats.size(), 2);
+    EXPECT_STREQ(stats[1].kind, "select");
+    EXPECT_EQ(stats[1].produced, as.size());
+    EXPECT_EQ(stats[1].invocations, as.size());
+}
+
+TEST_F(LinqTest, TestStatsJson) {
+    auto reversed = as_linqed.reverse();
+    for (const std::shared_ptr<A>& a : reversed) { (void)a; }
+    std::string json = reversed.stats().toJson();
+    EXPECT_EQ(json.find("{\"stages\":[{\"kind\":\"id\""), 0);
+    EXPECT_NE(json.find("\"kind\":\"reverse\""), std::string::npos);
+    EXPECT_NE(json.find("\"wallTimeNs\":"), std::string::npos);
+}
+
+TEST_F(LinqTest, TestStatsAllocations) {
+    std::vector<int> values{ 5, 3, 9, 1, 7 };
+    auto sorted = from(values).orderBy();
+    EXPECT_EQ(sorted.toVector(), (std::vector<int>{ 1, 3, 5, 7, 9 }));
+    pipeline_stats stats = sorted.stats();
+    EXPECT_GT(stats[stats.size() - 1].allocations, 0);
+    EXPECT_GE(stats[stats.size() - 1].allocatedBytes, values.size() * sizeof(int));
+
+    // Counted from every worker of a parallel stage at once
+    std::vector<int> many(20000, 1);
+    auto doubled = from(many).select(linq::parallel_t{ 64, 8 }, [](const int& v) { return 2 * v; });
+    EXPECT_EQ(doubled.toVector().size(), many.size());
+}
+
+TEST_F(LinqTest, TestStatsExplain) {
+    auto filtered = as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; });
+    EXPECT_EQ(filtered.explain().find("filter(fn) [random_access, O(n)] est<=13 actual=0\n"), 0);
+    for (const std::shared_ptr<A>& a : filtered) { (void)a; }
+    std::string plan = filtered.explain();
+    EXPECT_EQ(plan.find("filter(fn) [random_access, O(n)] est<=13 actual=7\n"), 0);
+}
+#else
+TEST_F(LinqTest, TestStatsDisabled) {
+    EXPECT_EQ(as_linqed.stats().size(), 0);
+    EXPECT_EQ(as_linqed.stats().toJson(), "{\"stages\":[]}");
+    auto filtered = as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; });
+    for (const std::shared_ptr<A>& a : filtered) { (void)a; }
+    EXPECT_EQ(filtered.explain().find(" actual="), std::string::npos);
+}
+#endif
+
+TEST_F(LinqTest, TestExplainFilterTake) {
+    auto taken = as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; }).take(5);
+    std::string plan = taken.explain();
+    size_t take = plan.find("take(5)");
+    size_t filter = plan.find("  filter(fn)");
+    size_t source = plan.find("    id [random_access, O(n)] est=13");
+    ASSERT_NE(take, std::string::npos);
+    ASSERT_NE(filter, std::string::npos);
+    ASSERT_NE(source, std::string::npos);
+    EXPECT_LT(take, filter);
+    EXPECT_LT(filter, source);
+    EXPECT_NE(plan.find("est<=5"), std::string::npos);
+}
+
+TEST_F(LinqTest, TestExplainDistinct) {
+    auto distinct = as_linqed.select([](const std::shared_ptr<A>& a) { return a->test() % 3; }).distinct();
+    std::string plan = distinct.explain();
+    EXPECT_EQ(plan.find("distinct [random_access, O(n log n)] est<=13"), 0);
+    EXPECT_NE(plan.find("  select(fn)"), std::string::npos);
+    ASSERT_NE(distinct.plan(), nullptr);
+    ASSERT_EQ(distinct.plan()->inputs.size(), 1);
+    EXPECT_STREQ(distinct.plan()->upstream()->kind, "select");
+}
+
+TEST_F(LinqTest, TestExplainRemoveAll) {
+    std::vector<std::shared_ptr<A>> toRemove{ as[0], as[1] };
+    auto removed = as_linqed.removeAll(toRemove);
+    EXPECT_EQ(removed.explain().find("removeAll [random_access, O(n + m)] est<=13"), 0);
+}
+
+TEST_F(LinqTest, TestOptimizeFilterFusion) {
+    // filter's own name is taken by its constructor so chained filters are built through it
+    auto filtered = linq::filter(as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; }),
+        [](const std::shared_ptr<A>& a) { return a->test() > 4; });
+    std::vector<int> expected{ 6, 8, 10, 12 };
+    size_t i = 0;
+    for (const std::shared_ptr<A>& a : filtered) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(a->test(), expected[i++]);
+    }
+    EXPECT_EQ(i, expected.size());
+    EXPECT_EQ(filtered.explain().find("filter(fn && fn)"), 0);
+    EXPECT_STREQ(filtered.plan()->upstream()->kind, "id");
+}
+
+template<typename... Args>
+auto doubled(const abstract_linq<Args...>& linqed) {
+    return linqed.select([](const int& a) { return a * 2; });
+}
+
+TEST_F(LinqTest, TestOptimizeSelectFusion) {
+    auto selected = doubled(as_linqed.select([](const std::shared_ptr<A>& a) { return a->test(); }));
+    int i = 0;
+    for (const int& a : selected) {
+        EXPECT_EQ(a, 2 * i++);
+    }
+    EXPECT_EQ(i, 13);
+    EXPECT_EQ(selected.explain().find("select(fn . fn)"), 0);
+    EXPECT_STREQ(selected.plan()->upstream()->kind, "id");
+}
+
+TEST_F(LinqTest, TestOptimizeFilterCount) {
+    EXPECT_EQ(as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; }).count(), 7);
+    EXPECT_EQ(as_const_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() > 20; }).count(), 0);
+    // It overrides the base count, so size() takes the same path and returns the same type
+    auto evens = as_linqed.filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; });
+    static_assert(std::is_same_v<decltype(evens.count()), decltype(evens.size())>);
+    EXPECT_EQ(evens.size(), 7);
+}
+
+TEST_F(LinqTest, TestOptimizeOrderByTake) {
+    std::vector<int> values{ 5, 3, 9, 1, 7, 3, 8 };
+    auto smallest = from(values).orderBy().take(3);
+    std::vector<int> expected{ 1, 3, 3 };
+    size_t i = 0;
+    for (const int& value : smallest) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(value, expected[i++]);
+    }
+    EXPECT_EQ(i, expected.size());
+    EXPECT_EQ(smallest.explain().find("topK(fn, 3) [random_access, materializes, O(n log k)] est=3"), 0);
+
+    auto largest = from(values).orderBy([](const int& a, const int& b) { return a > b; }).take(10);
+    std::vector<int> expectedLargest{ 9, 8, 7, 5, 3, 3, 1 };
+    i = 0;
+    for (const int& value : largest) {
+        ASSERT_LT(i, expectedLargest.size());
+        EXPECT_EQ(value, expectedLargest[i++]);
+    }
+    EXPECT_EQ(i, expectedLargest.size());
+    EXPECT_TRUE(from(values).orderBy().take(0).empty());
+}
+
+TEST_F(LinqTest, TestOptimizeOrderByChainedTake) {
+    std::vector<int> values{ 5, 3, 9, 1, 7, 3, 8 };
+    // take and skip compare a begin against another begin they advanced, so both have to agree on positions
+    EXPECT_EQ(from(values).orderBy().skip(4).toVector(), (std::vector<int>{ 7, 8, 9 }));
+    EXPECT_EQ(from(values).orderBy().select([](const int& value) { return value * 2; }).take(2).toVector(), (std::vector<int>{ 2, 6 }));
+    EXPECT_EQ(from(values).orderBy().take(10).take(5).toVector(), (std::vector<int>{ 1, 3, 3, 5, 7 }));
+    EXPECT_EQ(from(values).orderBy().take(5).skip(3).toVector(), (std::vector<int>{ 5, 7 }));
+    EXPECT_EQ(from(values).orderBy().take(5).take(1).count(), 1);
+}
+
+TEST_F(LinqTest, TestOptimizeOrderByFilter) {
+    std::vector<int> values{ 5, 3, 9, 1, 7, 4, 8 };
+    auto odd = from(values).orderBy().filter([](const int& value) { return value % 2 == 1; });
+    std::vector<int> expected{ 1, 3, 5, 7, 9 };
+    size_t i = 0;
+    for (const int& value : odd) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(value, expected[i++]);
+    }
+    EXPECT_EQ(i, expected.size());
+    EXPECT_EQ(odd.explain().find("orderBy"), 0);
+    EXPECT_STREQ(odd.plan()->upstream()->kind, "filter");
+}
+
+TEST_F(LinqTest, TestOptimizeReverseFilter) {
+    auto even = as_linqed.reverse().filter([](const std::shared_ptr<A>& a) { return a->test() % 2 == 0; });
+    int expected = 12;
+    for (const std::shared_ptr<A>& a : even) {
+        EXPECT_EQ(a->test(), expected);
+        expected -= 2;
+    }
+    EXPECT_EQ(expected, -2);
+    EXPECT_STREQ(even.plan()->kind, "reverse");
+    EXPECT_STREQ(even.plan()->upstream()->kind, "filter");
+}
+
+TEST_F(LinqTest, TestOptimizeSetUnion) {
+    std::vector<int> first{ 1, 2, 3, 2 };
+    std::vector<int> second{ 3, 4, 1, 5 };
+    auto united = linq::concat(first.cbegin(), first.cend(), second.cbegin(), second.cend()).distinct();
+    std::vector<int> expected{ 1, 2, 3, 4, 5 };
+    size_t i = 0;
+    for (const int& value : united) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(value, expected[i++]);
+    }
+    EXPECT_EQ(i, expected.size());
+    EXPECT_EQ(united.explain().find("setUnion [random_access, O(n + m)]"), 0);
+    EXPECT_STREQ(united.plan()->upstream()->kind, "concat");
+    // Copies share the hash set of the values seen so far
+    auto it = united.begin();
+    ++it;
+    auto copy = it;
+    ++it;
+    ++it;
+    EXPECT_EQ(*copy, 2);
+    EXPECT_EQ(*it, 4);
+    ++copy;
+    ++copy;
+    EXPECT_TRUE(copy == it);
+}
+
+struct Row {
+    int quantity;
+    double price;
+};
+
+TEST_F(LinqTest, TestExpressionEvaluate) {
+    auto predicate = _1 > 5 && _1 % 2 == 0;
+    EXPECT_TRUE(predicate(6));
+    EXPECT_FALSE(predicate(7));
+    EXPECT_FALSE(predicate(4));
+    EXPECT_EQ((-_1 + 3)(5), -2);
+    EXPECT_TRUE((!(_1 < 3))(3));
+    EXPECT_EQ(expr::toString(predicate), "((_1 > 5) && ((_1 % 2) == 0))");
+    // Short circuits like the built in operator
+    EXPECT_FALSE((_1 != 0 && 10 / _1 > 2)(0));
+
+    Row row{ 3, 2.5 };
+    EXPECT_DOUBLE_EQ((field(&Row::price) * field(&Row::quantity))(row), 7.5);
+    EXPECT_EQ(expr::toString(field(&Row::price, "price") * 1.5), "(price * 1.5)");
+    static_assert(expr::uses_argument_v<decltype(predicate)>);
+    static_assert(!expr::uses_argument_v<decltype(field(&Row::price) > 1.0)>);
+    EXPECT_TRUE(expr::only_uses(field(&Row::price) > 1.0 && field(&Row::price) < 2.0, &Row::price));
+    EXPECT_FALSE(expr::only_uses(field(&Row::price) > 1.0 && field(&Row::quantity) < 2, &Row::price));
+}
+
+TEST_F(LinqTest, TestExpressionPipeline) {
+    std::vector<int> values{ 1, 6, 3, 8, 10, 7, 12 };
+    auto filtered = from(values).filter(_1 > 5 && _1 % 2 == 0);
+    std::vector<int> expected{ 6, 8, 10, 12 };
+    size_t i = 0;
+    for (const int& value : filtered) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(value, expected[i++]);
+    }
+    EXPECT_EQ(i, expected.size());
+    EXPECT_EQ(filtered.explain().find("filter(((_1 > 5) && ((_1 % 2) == 0)))"), 0);
+
+    auto selected = from(values).select(_1 * 2);
+    i = 0;
+    for (const int& value : selected) {
+        EXPECT_EQ(value, values[i++] * 2);
+    }
+    EXPECT_EQ(selected.explain().find("select((_1 * 2))"), 0);
+}
+
+TEST_F(LinqTest, TestExpressionBounds) {
+    expr::interval<int> range = expr::bounds<int>(_1 > 5 && _1 <= 10);
+    EXPECT_TRUE(range.exact);
+    EXPECT_FALSE(range.contains(5));
+    EXPECT_TRUE(range.contains(6));
+    EXPECT_TRUE(range.contains(10));
+    EXPECT_FALSE(range.contains(11));
+    EXPECT_TRUE(range.overlaps(0, 6));
+    EXPECT_FALSE(range.overlaps(11, 20));
+
+    expr::interval<int> flipped = expr::bounds<int>(3 <= _1 && _1 % 2 == 0);
+    EXPECT_FALSE(flipped.exact);
+    EXPECT_FALSE(flipped.contains(2));
+    EXPECT_TRUE(flipped.contains(3));
+
+    EXPECT_TRUE(expr::bounds<int>(_1 > 5 && _1 < 3).empty());
+    EXPECT_TRUE(expr::bounds<int>(_1 == 4 && _1 < 4).empty());
+
+    expr::interval<double> price = expr::bounds<double>(field(&Row::price) >= 1.5 && field(&Row::quantity) > 2, field(&Row::price));
+    EXPECT_FALSE(price.exact);
+    EXPECT_TRUE(price.contains(1.5));
+    EXPECT_FALSE(price.contains(1.0));
+}
+
+TEST_F(LinqTest, TestExpressionBatch) {
+    std::vector<int> values(100);
+    for (int i = 0; i < 100; i++) values[i] = i;
+    std::vector<int> doubled(values.size());
+    expr::evaluate(_1 * 2, values.data(), values.data() + values.size(), doubled.data());
+    for (int i = 0; i < 100; i++) EXPECT_EQ(doubled[i], 2 * i);
+    EXPECT_EQ(expr::countIf(_1 % 3 == 0, values.data(), values.data() + values.size()), 34);
+}
+
+struct price {
+    using type = double;
+    static constexpr const char* name = "price";
+};
+
+struct quantity {
+    using type = int;
+    static constexpr const char* name = "quantity";
+};
+
+struct sku {
+    using type = std::string;
+};
+
+TEST_F(LinqTest, TestColumnsScan) {
+    columns<price, quantity, sku> table;
+    table.reserve(4);
+    table.push_back(1.5, 10, "a");
+    table.push_back(9.0, 3, "b");
+    table.push_back(4.0, 7, "c");
+    table.push_back(12.5, 1, "d");
+    EXPECT_EQ(table.size(), 4);
+    EXPECT_EQ(table.column<sku>()[2], "c");
+    EXPECT_EQ(table[1].get<quantity>(), 3);
+
+    auto quantities = from(table).filter(col<price> > 3.0).select(col<quantity>);
+    std::vector<int> expected{ 3, 7, 1 };
+    size_t i = 0;
+    for (const int& value : quantities) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(value, expected[i++]);
+    }
+    EXPECT_EQ(i, expected.size());
+    EXPECT_EQ(quantities.explain().find("select(quantity)"), 0);
+    EXPECT_NE(quantities.explain().find("filter((price > 3))"), std::string::npos);
+}
+
+TEST_F(LinqTest, TestColumnsWhere) {
+    columns<price, quantity> table;
+    for (int i = 0; i < 100; i++) table.push_back(i * 0.5, i % 7);
+    std::vector<size_t> matches = table.where(col<price> >= 10.0 && col<quantity> == 0);
+    std::vector<size_t> expected{ 21, 28, 35, 42, 49, 56, 63, 70, 77, 84, 91, 98 };
+    EXPECT_EQ(matches, expected);
+    EXPECT_EQ(table.count(col<quantity> == 0), 15);
+    EXPECT_EQ(expr::bounds<double>(col<price> >= 10.0 && col<quantity> == 0, col<price>).lower, 10.0);
+}
+
+struct Point {
+    int x;
+    double y;
+    std::string label;
+};
+
+TEST_F(LinqTest, TestToColumnsPairs) {
+    auto table = pairsSquared_const_linqed.filter([](const std::pair<int, int>& p) { return p.first % 2 == 0; }).toColumns();
+    ASSERT_EQ(table.size(), 7);
+    for (size_t i = 0; i < table.size(); i++) {
+        EXPECT_EQ(table.column<0>()[i], 2 * (int)i);
+        EXPECT_EQ(table.column<1>()[i], 4 * (int)(i * i));
+    }
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(table.column<0>().data()) % 64, 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(table.column<1>().data()) % 64, 0);
+
+    int sum = 0;
+    for (const int& second : from(table).select([](const auto& row) { return row.template get<1>(); })) sum += second;
+    EXPECT_EQ(sum, 4 * (0 + 1 + 4 + 9 + 16 + 25 + 36));
+    EXPECT_EQ(table[3].value(), std::make_tuple(6, 36));
+}
+
+TEST_F(LinqTest, TestToColumnsStruct) {
+    std::vector<Point> points{ { 1, 0.5, "a" }, { 2, 1.5, "b" }, { 3, 2.5, "c" } };
+    auto table = from(points).toColumns();
+    ASSERT_EQ(table.size(), 3);
+    EXPECT_EQ(table.column<0>()[2], 3);
+    EXPECT_DOUBLE_EQ(table.column<1>()[1], 1.5);
+    EXPECT_EQ(table.column<2>()[0], "a");
+    EXPECT_EQ(table.count(col<column_at<0, int>> >= 2), 2);
+
+    std::vector<int> values{ 4, 5, 6 };
+    auto single = from(values).toColumns();
+    ASSERT_EQ(single.size(), 3);
+    EXPECT_EQ(single.column<0>()[1], 5);
+}
+
+struct Order {
+    int customer;
+    std::string sku;
+    double total;
+};
+
+TEST_F(LinqTest, TestIndexEqualRange) {
+    std::vector<Order> orders{ { 3, "apple", 1.0 }, { 1, "banana", 2.0 }, { 3, "apricot", 3.0 }, { 2, "cherry", 4.0 },
+        { 5, "avocado", 5.0 }, { 3, "blueberry", 6.0 } };
+    auto byCustomer = linq::index(orders, [](const Order& o) { return o.customer; });
+    ASSERT_EQ(byCustomer.size(), 6);
+
+    std::vector<double> totals;
+    for (const Order& order : byCustomer.equal(3)) totals.push_back(order.total);
+    EXPECT_EQ(totals, (std::vector<double>{ 1.0, 3.0, 6.0 }));
+    EXPECT_EQ(byCustomer.equal(4).count(), 0);
+    EXPECT_EQ(byCustomer.range(2, 5).count(), 4);
+
+    std::vector<int> customers;
+    for (const Order& order : from(byCustomer)) customers.push_back(order.customer);
+    EXPECT_EQ(customers, (std::vector<int>{ 1, 2, 3, 3, 3, 5 }));
+
+    std::vector<double> filtered;
+    for (const Order& order : byCustomer.where(_1 > 1 && _1 <= 3 && _1 != 2)) filtered.push_back(order.total);
+    EXPECT_EQ(filtered, (std::vector<double>{ 1.0, 3.0, 6.0 }));
+}
+
+TEST_F(LinqTest, TestIndexPrefix) {
+    std::vector<Order> orders{ { 3, "apple", 1.0 }, { 1, "banana", 2.0 }, { 3, "apricot", 3.0 }, { 2, "cherry", 4.0 },
+        { 5, "avocado", 5.0 }, { 3, "blueberry", 6.0 } };
+    auto bySku = linq::index(orders, [](const Order& o) { return o.sku; });
+    std::vector<std::string> skus;
+    for (const Order& order : bySku.prefix("ap")) skus.push_back(order.sku);
+    EXPECT_EQ(skus, (std::vector<std::string>{ "apple", "apricot" }));
+    EXPECT_EQ(bySku.prefix("b").count(), 2);
+    EXPECT_EQ(bySku.prefix("z").count(), 0);
+}
+
+TEST_F(LinqTest, TestIndexHashedJoin) {
+    std::vector<Order> orders{ { 3, "apple", 1.0 }, { 1, "banana", 2.0 }, { 3, "apricot", 3.0 }, { 2, "cherry", 4.0 } };
+    auto byCustomer = linq::index(orders, [](const Order& o) { return o.customer; }, linq::hashed);
+    EXPECT_EQ(byCustomer.equal(3).count(), 2);
+    EXPECT_EQ(byCustomer.equal(7).count(), 0);
+
+    std::vector<int> customers{ 1, 4, 3, 2 };
+    auto joined = from(customers).join(byCustomer, [](const int& c) { return c; },
+        [](const int& c, const Order& o) { return c * 100 + (int)o.total; });
+    std::vector<int> results;
+    for (int value : joined) results.push_back(value);
+    EXPECT_EQ(results, (std::vector<int>{ 102, 301, 303, 204 }));
+    EXPECT_EQ(joined.explain().find("indexJoin(index, fn, fn) [random_access, O(n)]"), 0);
+
+    auto sorted = linq::index(orders, [](const Order& o) { return o.customer; });
+    auto sortedJoined = from(customers).join(sorted, [](const int& c) { return c; }, [](const int&, const Order& o) { return o.sku; });
+    std::vector<std::string> skus;
+    for (const std::string& sku : sortedJoined) skus.push_back(sku);
+    EXPECT_EQ(skus, (std::vector<std::string>{ "banana", "apple", "apricot", "cherry" }));
+}
+
+TEST_F(LinqTest, TestBitmap) {
+    bitmap evens(130);
+    bitmap thirds(130);
+    for (size_t i = 0; i < 130; i += 2) evens.set(i);
+    for (size_t i = 0; i < 130; i += 3) thirds.set(i);
+    EXPECT_EQ(evens.count(), 65);
+    EXPECT_EQ((evens & thirds).count(), 22);
+    EXPECT_EQ((evens | thirds).count(), 87);
+    EXPECT_EQ((~evens).count(), 65);
+    EXPECT_FALSE((~evens).test(128));
+    EXPECT_EQ(bitmap(evens).andNot(thirds).count(), 43);
+
+    bitmap both = evens & thirds;
+    std::vector<size_t> ids;
+    for (size_t id : from(both)) ids.push_back(id);
+    ASSERT_EQ(ids.size(), 22);
+    EXPECT_EQ(ids.front(), 0);
+    EXPECT_EQ(ids[1], 6);
+    EXPECT_EQ(ids.back(), 126);
+    bitmap empty(200);
+    EXPECT_EQ(from(empty).count(), 0);
+
+    auto last = both.end();
+    EXPECT_EQ(*--last, 126);
+    EXPECT_EQ(*--last, 120);
+}
+
+enum class Status { open, held, closed };
+
+struct Ticket {
+    Status status;
+    char region;
+    int id;
+};
+
+TEST_F(LinqTest, TestBitmapIndex) {
+    std::vector<Ticket> tickets;
+    for (int i = 0; i < 1000; i++) tickets.push_back({ static_cast<Status>(i % 3), "nsew"[i % 4], i });
+    auto byStatus = linq::index(tickets, [](const Ticket& t) { return t.status; }, linq::bitmapped);
+    auto byRegion = linq::index(tickets, [](const Ticket& t) { return t.region; }, linq::bitmapped);
+    EXPECT_EQ(byStatus.keys().size(), 3);
+
+    bitmap matches = byStatus.in({ Status::open, Status::held }) & byRegion.equal('e');
+    size_t expected = 0;
+    for (const Ticket& t : tickets) expected += t.status != Status::closed && t.region == 'e';
+    EXPECT_EQ(matches.count(), expected);
+    EXPECT_EQ(byStatus.where(_1 != Status::closed), byStatus.in({ Status::open, Status::held }));
+
+    int previous = -1;
+    size_t visited = 0;
+    for (const Ticket& t : byStatus.rows(byStatus.equal(Status::held) & byRegion.equal('n'))) {
+        EXPECT_EQ(t.status, Status::held);
+        EXPECT_EQ(t.region, 'n');
+        EXPECT_GT(t.id, previous);
+        previous = t.id;
+        visited++;
+    }
+    EXPECT_EQ(visited, 83);
+    EXPECT_EQ(byRegion.equal('x').count(), 0);
+}
+
+struct Event {
+    long long timestamp;
+    std::optional<int> severity;
+};
+
+TEST_F(LinqTest, TestZoneMapSkipsChunks) {
+    std::vector<Event> events;
+    for (long long i = 0; i < 10000; i++) events.push_back({ 1000 + i * 10, i % 50 == 0 ? std::nullopt : std::optional<int>(i % 7) });
+    zone_map byTime(events, [](const Event& e) { return e.timestamp; }, 100);
+    ASSERT_EQ(byTime.zones().size(), 100);
+    EXPECT_EQ(*byTime.zones()[3].min, 1000 + 300 * 10);
+    EXPECT_EQ(*byTime.zones()[3].max, 1000 + 399 * 10);
+    EXPECT_NEAR(byTime.zones()[3].distinct, 100, 10);
+
+    auto window = byTime.filter(_1 >= 21000 && _1 < 26000);
+    std::vector<long long> expected;
+    for (const Event& e : events) if (e.timestamp >= 21000 && e.timestamp < 26000) expected.push_back(e.timestamp);
+    std::vector<long long> actual;
+    for (const Event& e : window) actual.push_back(e.timestamp);
+    EXPECT_EQ(actual, expected);
+
+    // The window starts and ends on chunk boundaries, so every row is accepted without testing it
+    std::vector<zone_span> spans = byTime.spans(_1 >= 21000 && _1 < 26000);
+    ASSERT_EQ(spans.size(), 1);
+    EXPECT_EQ(spans[0].first, 2000);
+    EXPECT_EQ(spans[0].last, 2500);
+    EXPECT_FALSE(spans[0].check);
+    EXPECT_EQ(window.explain().find("zoneFilter(((_1 >= 21000) && (_1 < 26000)), 5/100 chunks) [random_access, O(n)] est<=500"), 0);
+    EXPECT_EQ(byTime.filter(_1 > 1000000).count(), 0);
+}
+
+TEST_F(LinqTest, TestZoneMapNulls) {
+    std::vector<Event> events;
+    for (long long i = 0; i < 1000; i++) events.push_back({ i, i % 50 == 0 ? std::nullopt : std::optional<int>(i % 7) });
+    zone_map bySeverity(events, [](const Event& e) { return e.severity; }, 100);
+    EXPECT_EQ(bySeverity.zones()[0].nulls, 2);
+    EXPECT_EQ(*bySeverity.zones()[0].min, 0);
+    EXPECT_EQ(*bySeverity.zones()[0].max, 6);
+    EXPECT_LE(bySeverity.zones()[0].distinct, 8);
+    EXPECT_GE(bySeverity.zones()[0].distinct, 6);
+
+    size_t expected = 0;
+    for (const Event& e : events) expected += e.severity && *e.severity >= 5;
+    EXPECT_EQ(bySeverity.filter(_1 >= 5).count(), expected);
+    EXPECT_EQ(bySeverity.filter(_1 >= 0).count(), 980);
+}
+
+TEST_F(LinqTest, TestViewRefresh) {
+    std::vector<int> log{ 1, 2, 3, 4, 5 };
+    auto evens = linq::view(log, [](auto rows) { return linq::filter(rows, [](const int& v) { return v % 2 == 0; }); });
+    EXPECT_EQ(evens.result(), (std::vector<int>{ 2, 4 }));
+    EXPECT_EQ(evens.refresh(), 0);
+
+    for (int i = 6; i < 1000; i++) log.push_back(i);
+    EXPECT_EQ(evens.refresh(), 994);
+    EXPECT_EQ(evens.processed(), 999);
+    ASSERT_EQ(evens.result().size(), 499);
+    EXPECT_EQ(evens.result().back(), 998);
+
+    int visited = 0;
+    auto counted = linq::view(log, [&visited](auto rows) {
+        return linq::select(rows, [&visited](const int& v) { visited++; return v; });
+    }, incremental::count());
+    EXPECT_EQ(counted.result(), 999);
+    log.push_back(1000);
+    log.push_back(1001);
+    EXPECT_EQ(counted.refresh(), 2);
+    EXPECT_EQ(counted.result(), 1001);
+    EXPECT_EQ(visited, 1001);
+
+    auto squares = linq::view(log, [](auto rows) { return linq::select(rows, [](const int& v) { return v * v; }).take(3); });
+    EXPECT_EQ(squares.result(), (std::vector<int>{ 1, 4, 9 }));
+}
+
+TEST_F(LinqTest, TestViewGroupDistinct) {
+    std::vector<std::pair<std::string, int>> sales{ { "eu", 3 }, { "us", 5 }, { "eu", 2 } };
+    auto totals = linq::view(sales, [](auto rows) { return rows; },
+        incremental::group([](const std::pair<std::string, int>& sale) { return sale.first; }, 0,
+            [](int total, const std::pair<std::string, int>& sale) { return total + sale.second; }));
+    EXPECT_EQ(totals.result().at("eu"), 5);
+    sales.push_back({ "us", 1 });
+    sales.push_back({ "apac", 7 });
+    totals.refresh();
+    EXPECT_EQ(totals.result().size(), 3);
+    EXPECT_EQ(totals.result().at("us"), 6);
+    EXPECT_EQ(totals.result().at("apac"), 7);
+
+    auto regions = linq::view(sales, [](auto rows) { return linq::select(rows, [](const std::pair<std::string, int>& sale) { return sale.first; }); },
+        incremental::distinct<std::string>());
+    sales.push_back({ "eu", 1 });
+    sales.push_back({ "latam", 1 });
+    regions.refresh();
+    EXPECT_EQ(regions.result(), (std::vector<std::string>{ "eu", "us", "apac", "latam" }));
+
+    auto sum = linq::view(sales, [](auto rows) { return rows; },
+        incremental::aggregate(0, [](int total, const std::pair<std::string, int>& sale) { return total + sale.second; }));
+    EXPECT_EQ(sum.result(), 20);
+}
+
+#ifdef LINQ_HAS_COROUTINES
+linq::generator<int> naturals(int limit) {
+    for (int i = 0; i < limit; i++) co_yield i;
+}
+
+// Counts the frames it allocates so the test can tell the generator used it
+template<typename T>
+struct counting_allocator {
+    using value_type = T;
+    size_t* allocations;
+
+    counting_allocator(size_t* allocations) : allocations(allocations) {}
+
+    template<typename U>
+    counting_allocator(const counting_allocator<U>& other) : allocations(other.allocations) {}
+
+    T* allocate(size_t n) {
+        ++*this->allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+// GCC pairs the frame's allocator_arg operator new with the sized operator delete every coroutine frame is freed
+// through and reports them as mismatched, which they aren't
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+linq::generator<std::string, counting_allocator<std::byte>> pages(std::allocator_arg_t, counting_allocator<std::byte>, int count) {
+    for (int page = 0; page < count; page++) {
+        for (int row = 0; row < 3; row++) co_yield std::to_string(page) + ":" + std::to_string(row);
+    }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+TEST_F(LinqTest, TestGeneratorPipeline) {
+    auto numbers = naturals(20);
+    auto squares = from(numbers).filter([](const int& v) { return v % 3 == 0; }).select([](const int& v) { return v * v; });
+    std::vector<int> result;
+    for (int value : squares) result.push_back(value);
+    EXPECT_EQ(result, (std::vector<int>{ 0, 9, 36, 81, 144, 225, 324 }));
+
+    // Single pass, the generator is already exhausted
+    EXPECT_EQ(numbers.begin(), numbers.end());
+}
+
+TEST_F(LinqTest, TestGeneratorAllocator) {
+    size_t allocations = 0;
+    {
+        auto rows = pages(std::allocator_arg, counting_allocator<std::byte>(&allocations), 4);
+        std::vector<std::string> lastRows;
+        for (const std::string& row : from(rows).filter([](const std::string& r) { return r.back() == '2'; })) lastRows.push_back(row);
+        EXPECT_EQ(lastRows, (std::vector<std::string>{ "0:2", "1:2", "2:2", "3:2" }));
+    }
+    EXPECT_EQ(allocations, 1);
+}
+#endif
+
+TEST_F(LinqTest, TestAsyncPreservesOrder) {
+    std::vector<int> values(10000);
+    for (int i = 0; i < 10000; i++) values[i] = i;
+    std::thread::id consumer = std::this_thread::get_id();
+    std::atomic<bool> otherThread{ false };
+    auto parsed = from(values).select([&otherThread, consumer](const int& v) {
+        if (std::this_thread::get_id() != consumer) otherThread = true;
+        return v * 2;
+    });
+    auto handedOver = parsed.async(16);
+    long long sum = 0;
+    int expected = 0;
+    for (int value : handedOver) {
+        EXPECT_EQ(value, expected);
+        expected += 2;
+        sum += value;
+    }
+    EXPECT_EQ(expected, 20000);
+    EXPECT_EQ(sum, 2LL * 9999 * 10000 / 2);
+    EXPECT_TRUE(otherThread);
+    EXPECT_EQ(handedOver.take(5).toVector(), (std::vector<int>{ 0, 2, 4, 6, 8 }));
+    EXPECT_EQ(handedOver.skip(9997).toVector(), (std::vector<int>{ 19994, 19996, 19998 }));
+    EXPECT_EQ(handedOver.explain().find("async(16) [input"), 0);
+
+    // Stopping early cancels the producer instead of waiting for it to finish
+    for (int value : handedOver) {
+        if (value > 10) break;
+    }
+    std::vector<int> empty;
+    EXPECT_EQ(from(empty).async(4).count(), 0);
+}
+
+TEST_F(LinqTest, TestSpscRing) {
+    spsc_ring<std::string> ring(3);
+    EXPECT_EQ(ring.capacity(), 4);
+    for (int i = 0; i < 4; i++) EXPECT_TRUE(ring.tryPush(std::to_string(i)));
+    EXPECT_FALSE(ring.tryPush(std::string("full")));
+    EXPECT_TRUE(ring.full());
+    EXPECT_EQ(*ring.tryPop(), "0");
+    EXPECT_FALSE(ring.full());
+    EXPECT_TRUE(ring.tryPush(std::string("4")));
+    for (int i = 1; i < 5; i++) EXPECT_EQ(*ring.tryPop(), std::to_string(i));
+    EXPECT_FALSE(ring.tryPop());
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST_F(LinqTest, TestParallelSelectKeepsOrder) {
+    std::vector<int> values(20000);
+    for (int i = 0; i < 20000; i++) values[i] = i;
+    // Which threads end up running the chunks depends on the machine, the order of the rows must not
+    linq::thread_pool pool(4);
+    auto squared = from(values).select(linq::parallel_t{ 256, 8 }.on(pool), [](const int& v) { return static_cast<long long>(v) * v; });
+    long long i = 0;
+    for (long long value : squared) {
+        ASSERT_EQ(value, i * i);
+        i++;
+    }
+    EXPECT_EQ(i, 20000);
+    EXPECT_EQ(squared.explain().find("select(par, fn)"), 0);
+}
+
+TEST_F(LinqTest, TestParallelTakeSkip) {
+    std::vector<int> values(1000);
+    for (int i = 0; i < 1000; i++) values[i] = i;
+    linq::thread_pool pool(4);
+    linq::parallel_t policy = linq::parallel_t{ 64 }.on(pool);
+    auto doubled = from(values).select(policy, [](const int& v) { return 2 * v; });
+    EXPECT_EQ(doubled.take(5).toVector(), (std::vector<int>{ 0, 2, 4, 6, 8 }));
+    auto last = doubled.skip(997);
+    EXPECT_EQ(last.toVector(), (std::vector<int>{ 1994, 1996, 1998 }));
+    // Walking it again doesn't find the rows used up by the first walk
+    EXPECT_EQ(last.toVector(), (std::vector<int>{ 1994, 1996, 1998 }));
+    // The rows taken straddle two chunks
+    EXPECT_EQ(doubled.skip(62).take(3).toVector(), (std::vector<int>{ 124, 126, 128 }));
+    auto odd = from(values).filter(policy, [](const int& v) { return v % 2 == 1; });
+    EXPECT_EQ(odd.take(5).toVector(), (std::vector<int>{ 1, 3, 5, 7, 9 }));
+    EXPECT_EQ(odd.skip(498).toVector(), (std::vector<int>{ 997, 999 }));
+    EXPECT_EQ(from(values).select(linq::par, [](const int& v) { return v; }).take(5).count(), 5);
+}
+
+TEST_F(LinqTest, TestParallelFilterMatchesSequential) {
+    std::vector<int> values(10007);
+    for (int i = 0; i < 10007; i++) values[i] = (i * 7919) % 10007;
+    auto prime = [](const int& v) {
+        if (v < 2) return false;
+        for (int d = 2; d * d <= v; d++) if (v % d == 0) return false;
+        return true;
+    };
+    auto sequential = from(values).filter(prime).toVector();
+    auto parallel = from(values).filter(linq::par, prime).toVector();
+    EXPECT_EQ(parallel, sequential);
+
+    std::vector<int> sparse(5000, 4);
+    sparse[4321] = 7;
+    auto found = from(sparse).filter(linq::parallel_t{ 100, 3 }, prime).toVector();
+    EXPECT_EQ(found, std::vector<int>{ 7 });
+    std::vector<int> empty;
+    EXPECT_EQ(from(empty).select(linq::par, [](const int& v) { return v; }).count(), 0);
+
+    // A filtered input can't jump to a chunk, it is still walked a bounded number of times instead of once per chunk
+    std::atomic<size_t> tested{ 0 };
+    auto odd = from(values).filter([&tested](const int& v) { tested++; return v % 2 == 1; });
+    auto doubled = odd.select(linq::parallel_t{ 64, 4 }, [](const int& v) { return 2 * v; }).toVector();
+    EXPECT_EQ(doubled.size(), 5003);
+    for (size_t i = 0; i < doubled.size(); i++) ASSERT_EQ(doubled[i] % 4, 2);
+    EXPECT_LE(tested.load(), 3 * values.size());
+}
+
+TEST_F(LinqTest, TestThreadPoolStats) {
+    std::atomic<int> done{ 0 };
+    {
+        linq::thread_pool pool(4);
+        EXPECT_EQ(pool.concurrency(), 4);
+        // Every task spawns more work onto its own worker's deque, the idle workers have to steal it
+        for (int i = 0; i < 8; i++) {
+            pool.submit([&pool, &done]() {
+                for (int j = 0; j < 50; j++) pool.submit([&done]() { done++; });
+                done++;
+            });
+        }
+        while (done < 408) std::this_thread::yield();
+        size_t executed = 0;
+        for (const linq::worker_stats& stats : pool.stats()) executed += stats.executed;
+        EXPECT_EQ(executed, 408);
+    }
+    EXPECT_EQ(done, 408);
+}
+
+TEST_F(LinqTest, TestParallelExecutors) {
+    std::vector<int> values(5000);
+    for (int i = 0; i < 5000; i++) values[i] = i;
+    auto plus = [](long long a, const int& b) { return a + b; };
+    auto combine = [](long long a, long long b) { return a + b; };
+
+    // A single worker has to help out with the nested stages or it would wait on itself
+    linq::thread_pool pool(1);
+    long long nested = from(values).aggregate(linq::parallel_t{ 500 }.on(pool), 0LL, [&](long long a, const int& v) {
+        return a + (v % 1000 == 0 ? from(values).aggregate(linq::parallel_t{ 1000 }.on(pool), 0LL, plus, combine) : 0);
+    }, combine);
+    EXPECT_EQ(nested, 5 * 12497500LL);
+
+    linq::inline_executor inlined;
+    std::set<std::thread::id> threads;
+    from(values).forEach(linq::par.on(inlined), [&](const int&) { threads.insert(std::this_thread::get_id()); });
+    EXPECT_EQ(threads, std::set<std::thread::id>{ std::this_thread::get_id() });
+
+    std::vector<std::function<void()>> scheduled;
+    linq::external_executor external([&](std::function<void()> task) { scheduled.push_back(task); task(); }, 2);
+    EXPECT_EQ(from(values).aggregate(linq::parallel_t{ 1000 }.on(external), 0LL, plus, combine), 12497500LL);
+    EXPECT_EQ(scheduled.size(), 5);
+    EXPECT_EQ(from(values).select(linq::par.on(external), [](const int& v) { return v * 2; }).toVector().back(), 9998);
+}
+
+TEST_F(LinqTest, TestExceptIntersect) {
+    std::vector<int> values{ 5, 1, 4, 1, 5, 9, 2, 6, 5, 3 };
+    std::vector<int> blocked{ 5, 9, 7 };
+    EXPECT_EQ(from(values).except(blocked).toVector(), (std::vector<int>{ 1, 4, 2, 6, 3 }));
+    EXPECT_EQ(from(values).intersect(blocked).toVector(), (std::vector<int>{ 5, 9 }));
+    // Left is smaller so it is the side that gets hashed, the output still follows it
+    std::vector<int> many(1000);
+    for (int i = 0; i < 1000; i++) many[i] = 999 - i;
+    EXPECT_EQ(from(values).intersect(many).toVector(), (std::vector<int>{ 5, 1, 4, 9, 2, 6, 3 }));
+    EXPECT_EQ(from(many).intersect(values).count(), 7);
+    auto removed = from(values).removeAll(blocked);
+    EXPECT_EQ(removed.toVector(), (std::vector<int>{ 1, 4, 1, 2, 6, 3 }));
+    EXPECT_EQ(removed.explain().find("removeAll [random_access, O(n + m)] est<=10"), 0);
+    EXPECT_EQ(from(values).except(blocked).explain().find("except [random_access, O(n + m)] est<=10"), 0);
+    auto kept = from(values).except(blocked);
+    auto it = kept.begin();
+    auto copy = it;
+    ++it;
+    ++it;
+    EXPECT_EQ(*it, 2);
+    ++copy;
+    EXPECT_EQ(*copy, 4);
+    ++copy;
+    EXPECT_TRUE(copy == it);
+
+    flat_hash_set<int> set;
+    for (int i = 0; i < 10000; i += 3) EXPECT_TRUE(set.insert(i * 1024));
+    EXPECT_FALSE(set.insert(3 * 1024));
+    EXPECT_EQ(set.size(), 3334);
+    EXPECT_TRUE(set.contains(9999 * 1024));
+    EXPECT_FALSE(set.contains(10000 * 1024));
+}
+
+TEST_F(LinqTest, TestSortedSetOperations) {
+    std::vector<int> left{ 1, 2, 2, 4, 7, 9, 9 };
+    std::vector<int> right{ 2, 3, 4, 4, 8, 9 };
+    EXPECT_EQ(from(left).setUnion(right, linq::sorted).toVector(), (std::vector<int>{ 1, 2, 3, 4, 7, 8, 9 }));
+    EXPECT_EQ(from(left).intersect(right, linq::sorted).toVector(), (std::vector<int>{ 2, 4, 9 }));
+    EXPECT_EQ(from(left).except(right, linq::sorted).toVector(), (std::vector<int>{ 1, 7 }));
+    EXPECT_EQ(from(right).except(left, linq::sorted).toVector(), (std::vector<int>{ 3, 8 }));
+    std::vector<int> empty;
+    EXPECT_EQ(from(empty).setUnion(right, linq::sorted).toVector(), (std::vector<int>{ 2, 3, 4, 8, 9 }));
+    EXPECT_EQ(from(left).intersect(empty, linq::sorted).count(), 0);
+    EXPECT_EQ(from(left).except(empty, linq::sorted).toVector(), (std::vector<int>{ 1, 2, 4, 7, 9 }));
+    EXPECT_EQ(from(left).intersect(right, linq::sorted).explain().find("intersect(sorted) [random_access, O(n + m)]"), 0);
+}
+
+TEST_F(LinqTest, TestSortedIntKernels) {
+    std::mt19937 random(7);
+    // Balanced sizes go through the block comparisons, skewed ones gallop
+    for (size_t sizes : { 1000, 40000 }) {
+        std::set<uint32_t> left32;
+        std::set<uint32_t> right32;
+        std::set<int64_t> left64;
+        std::set<int64_t> right64;
+        while (left32.size() < 1000) left32.insert(random() % 50000);
+        while (right32.size() < sizes) right32.insert(random() % 50000);
+        for (uint32_t value : left32) left64.insert(static_cast<int64_t>(value) * -3);
+        for (uint32_t value : right32) right64.insert(static_cast<int64_t>(value) * -3);
+
+        auto check = [](const auto& left, const auto& right) {
+            using T = typename std::decay_t<decltype(left)>::value_type;
+            std::vector<T> a(left.begin(), left.end());
+            std::vector<T> b(right.begin(), right.end());
+            std::vector<T> expected;
+            std::vector<T> out(a.size() + b.size());
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+            EXPECT_EQ(sortedIntersectionCount(a.data(), a.size(), b.data(), b.size()), expected.size());
+            out.resize(sortedIntersection(b.data(), b.size(), a.data(), a.size(), out.data()));
+            EXPECT_EQ(out, expected);
+
+            expected.clear();
+            out.resize(a.size() + b.size());
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+            EXPECT_EQ(sortedDifferenceCount(a.data(), a.size(), b.data(), b.size()), expected.size());
+            out.resize(sortedDifference(a.data(), a.size(), b.data(), b.size(), out.data()));
+            EXPECT_EQ(out, expected);
+
+            expected.clear();
+            out.resize(a.size() + b.size());
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+            EXPECT_EQ(sortedUnionCount(a.data(), a.size(), b.data(), b.size()), expected.size());
+            out.resize(sortedUnion(b.data(), b.size(), a.data(), a.size(), out.data()));
+            EXPECT_EQ(out, expected);
+        };
+        check(left32, right32);
+        check(left64, right64);
+    }
+}
+
+TEST_F(LinqTest, TestSortedInts) {
+    std::vector<uint32_t> posting1{ 1, 3, 5, 7, 9, 11, 13, 15, 17, 19 };
+    std::vector<uint32_t> posting2{ 3, 4, 5, 6, 7, 8, 9, 10 };
+    sorted_ints first(posting1);
+    sorted_ints second(posting2);
+    EXPECT_EQ(first.intersectCount(second), 4);
+    EXPECT_EQ(first.unionCount(second), 14);
+    EXPECT_EQ(first.exceptCount(second), 6);
+    EXPECT_EQ(first.except(second).toVector(), (std::vector<uint32_t>{ 1, 11, 13, 15, 17, 19 }));
+    EXPECT_EQ(second.setUnion(first).count(), 14);
+    // The result owns its values, so stages built on a temporary one stay valid
+    auto large = first.intersect(second).filter([](const uint32_t& v) { return v > 4; });
+    EXPECT_EQ(large.toVector(), (std::vector<uint32_t>{ 5, 7, 9 }));
+    EXPECT_EQ(first.intersect(second).explain().find("intersect(sorted ints) [random_access, O(n + m)] est<=4"), 0);
+}
+
+TEST_F(LinqTest, TestRoaring) {
+    roaring sparse{ 7, 3, 70000, 3, 1u << 31 };
+    EXPECT_EQ(sparse.size(), 4);
+    EXPECT_TRUE(sparse.contains(70000));
+    EXPECT_FALSE(sparse.contains(70001));
+    EXPECT_EQ(from(sparse).toVector(), (std::vector<uint32_t>{ 3, 7, 70000, 1u << 31 }));
+
+    // Every third value switches the first chunk to a bitmap, the second stays an array
+    std::vector<int> ids;
+    for (int i = 0; i < 100000; i += 3) ids.push_back(i);
+    roaring thirds = from(ids).toRoaring();
+    EXPECT_EQ(thirds.size(), 33334);
+    EXPECT_TRUE(thirds.contains(99999));
+    EXPECT_FALSE(thirds.contains(99998));
+    roaring both = thirds & sparse;
+    EXPECT_EQ(from(both).toVector(), (std::vector<uint32_t>{ 3 }));
+    EXPECT_EQ((thirds | sparse).size(), 33334 + 3);
+    EXPECT_EQ((thirds - sparse).size(), 33333);
+    EXPECT_EQ(from(thirds).count(), 33334);
+    EXPECT_EQ(*--thirds.end(), 99999u);
+
+    EXPECT_EQ(from(ids).removeAll(sparse).count(), 33333);
+    auto kept = from(ids).retainAll(sparse);
+    EXPECT_EQ(kept.toVector(), std::vector<int>{ 3 });
+    EXPECT_EQ(kept.explain().find("retainAll(roaring) [random_access, O(n)]"), 0);
+
+    // The filter keeps its own copy, so a temporary set doesn't dangle
+    auto dropped = from(ids).removeAll(both | sparse);
+    EXPECT_EQ(dropped.count(), 33333);
+    std::vector<int64_t> wide{ 1, 1ll << 32 };
+    EXPECT_THROW(from(wide).toRoaring(), const char*);
+    std::vector<int> negative{ 1, -1 };
+    EXPECT_THROW(from(negative).toRoaring(), const char*);
+}
+
+TEST_F(LinqTest, TestRoaringRuns) {
+    roaring dense;
+    for (uint32_t i = 1000; i < 60000; i++) dense.add(i);
+    for (uint32_t i = 65536; i < 65546; i++) dense.add(i);
+    roaring copy = dense;
+    size_t bitmapBytes = dense.bytes();
+    dense.runOptimize();
+    EXPECT_LT(dense.bytes() * 20, bitmapBytes);
+    EXPECT_EQ(dense, copy);
+    EXPECT_TRUE(dense.contains(59999));
+    EXPECT_FALSE(dense.contains(60000));
+    EXPECT_FALSE(dense.contains(999));
+    roaring gaps{ 999, 1000, 5000, 65540, 70000 };
+    EXPECT_EQ(from(dense & gaps).toVector(), (std::vector<uint32_t>{ 1000, 5000, 65540 }));
+    EXPECT_EQ((dense - gaps).size(), 59000 - 2 + 9);
+    // Adding expands the runs again
+    dense.add(60000);
+    EXPECT_EQ(dense.size(), 59011);
+    EXPECT_EQ(from(dense).reverse().first(), 65545u);
+}
+
+TEST_F(LinqTest, TestConcatAll) {
+    std::vector<std::vector<int>> shards(200);
+    for (int i = 0; i < 1000; i++) shards[(i * 7) % 200].push_back(i);
+    shards[3].clear();
+    auto all = concatAll(shards);
+    std::vector<int> expected;
+    for (const std::vector<int>& shard : shards) expected.insert(expected.end(), shard.begin(), shard.end());
+    EXPECT_EQ(all.toVector(), expected);
+    EXPECT_EQ(all.count(), 995);
+    auto sum = [](int total, const int& v) { return total + v; };
+    EXPECT_EQ(all.aggregate(0, sum), from(expected).aggregate(0, sum));
+    // Jumps go straight to the right shard
+    auto it = all.begin();
+    it += 500;
+    EXPECT_EQ(*it, expected[500]);
+    it -= 499;
+    EXPECT_EQ(*it, expected[1]);
+    --it;
+    EXPECT_EQ(*it, expected[0]);
+    auto end = all.begin();
+    end += 995;
+    EXPECT_TRUE(end == all.end());
+    --end;
+    EXPECT_EQ(*end, expected.back());
+    EXPECT_EQ(all.explain().find("concatAll(199 ranges) [random_access, O(n)] est=995"), 0);
+
+    std::vector<int> first{ 1, 2 };
+    std::vector<int> second;
+    std::vector<int> third{ 3 };
+    auto joined = concatAll(first, second, third);
+    EXPECT_EQ(joined.toVector(), (std::vector<int>{ 1, 2, 3 }));
+    // Rows are the ranges' own elements
+    *joined.begin() = 10;
+    EXPECT_EQ(first[0], 10);
+    std::vector<std::vector<int>> none;
+    EXPECT_EQ(concatAll(none).count(), 0);
+    EXPECT_TRUE(concatAll(none).begin() == concatAll(none).end());
+}
+
+TEST_F(LinqTest, TestWindow) {
+    std::vector<int> values{ 4, 1, 3, 8, 2, 7, 5 };
+    std::vector<std::vector<int>> windows;
+    for (const auto& w : from(values).window(3)) windows.push_back(w.toVector());
+    EXPECT_EQ(windows, (std::vector<std::vector<int>>{ { 4, 1, 3 }, { 1, 3, 8 }, { 3, 8, 2 }, { 8, 2, 7 }, { 2, 7, 5 } }));
+
+    auto maxes = from(values).window(3).select([](const window_view<int>& w) { return w.max(); });
+    EXPECT_EQ(maxes.toVector(), (std::vector<int>{ 4, 8, 8, 8, 7 }));
+    auto mins = from(values).window(3).select([](const window_view<int>& w) { return w.min(); });
+    EXPECT_EQ(mins.toVector(), (std::vector<int>{ 1, 1, 2, 2, 2 }));
+    auto sums = from(values).window(3).select([](const window_view<int>& w) { return w.sum(); });
+    EXPECT_EQ(sums.toVector(), (std::vector<long long>{ 8, 12, 13, 17, 14 }));
+
+    // Matches computing each window from scratch
+    std::mt19937 random(7);
+    std::vector<double> noise(500);
+    for (double& v : noise) v = std::uniform_real_distribution<double>(-100, 100)(random);
+    size_t position = 0;
+    for (const auto& w : from(noise).window(20, 3)) {
+        double mean = 0;
+        for (size_t i = 0; i < 20; i++) mean += noise[position + i];
+        mean /= 20;
+        double variance = 0;
+        for (size_t i = 0; i < 20; i++) variance += (noise[position + i] - mean) * (noise[position + i] - mean);
+        EXPECT_NEAR(w.mean(), mean, 1e-9);
+        EXPECT_NEAR(w.variance(), variance / 20, 1e-7);
+        EXPECT_EQ(w.max(), *std::max_element(noise.begin() + position, noise.begin() + position + 20));
+        EXPECT_EQ(w.front(), noise[position]);
+        position += 3;
+    }
+    EXPECT_EQ(position, 161 * 3);
+
+    // Steps longer than the window skip rows
+    EXPECT_EQ(from(values).window(2, 3).select([](const window_view<int>& w) { return w.back(); }).toVector(), (std::vector<int>{ 1, 2 }));
+    EXPECT_EQ(from(values).window(8).count(), 0);
+    EXPECT_EQ(from(values).window(3, 2).explain().find("window(3, 2)"), 0);
+}
+
+TEST_F(LinqTest, TestTumble) {
+    std::vector<int> values{ 1, 2, 3, 4, 5, 6, 7 };
+    std::vector<std::vector<int>> batches;
+    from(values).tumble(3).forEach([&batches](const window_view<int>& w) { batches.push_back(w.toVector()); });
+    EXPECT_EQ(batches, (std::vector<std::vector<int>>{ { 1, 2, 3 }, { 4, 5, 6 }, { 7 } }));
+    auto means = from(values).tumble(2).select([](const window_view<int>& w) { return w.mean(); });
+    EXPECT_EQ(means.toVector(), (std::vector<double>{ 1.5, 3.5, 5.5, 7 }));
+    EXPECT_EQ(from(values).tumble(7).count(), 1);
+    std::vector<int> none;
+    EXPECT_EQ(from(none).tumble(3).count(), 0);
+
+    std::vector<std::string> words{ "a", "b", "c" };
+    EXPECT_EQ(from(words).tumble(2).select([](const window_view<std::string>& w) { return w.front() + w.back(); }).toVector(),
+        (std::vector<std::string>{ "ab", "cc" }));
+}
+
+TEST_F(LinqTest, TestChunk) {
+    std::vector<int> values{ 1, 2, 3, 4, 5, 6, 7 };
+    std::vector<std::vector<int>> batches;
+    std::vector<const int*> starts;
+    from(values).chunk(3).forEach([&batches, &starts](const chunk_view<int>& batch) {
+        batches.push_back(batch.toVector());
+        starts.push_back(batch.data());
+    });
+    EXPECT_EQ(batches, (std::vector<std::vector<int>>{ { 1, 2, 3 }, { 4, 5, 6 }, { 7 } }));
+    // Batches of a vector are views into it
+    EXPECT_EQ(starts, (std::vector<const int*>{ &values[0], &values[3], &values[6] }));
+    EXPECT_EQ(from(values).chunk(7).count(), 1);
+    EXPECT_EQ(from(values).chunk(100).select([](const chunk_view<int>& batch) { return batch.size(); }).toVector(), std::vector<size_t>{ 7 });
+
+    // Other inputs go through a reused buffer
+    auto odd = from(values).filter([](const int& v) { return v % 2 == 1; }).chunk(2);
+    std::vector<std::vector<int>> oddBatches;
+    for (const auto& batch : odd) {
+        EXPECT_TRUE(batch.data() < values.data() || batch.data() >= values.data() + values.size());
+        oddBatches.push_back(batch.toVector());
+    }
+    EXPECT_EQ(oddBatches, (std::vector<std::vector<int>>{ { 1, 3 }, { 5, 7 } }));
+    std::deque<int> blocks{ 1, 2, 3 };
+    EXPECT_EQ(from(blocks).chunk(2).select([](const chunk_view<int>& batch) { return batch.back(); }).toVector(), (std::vector<int>{ 2, 3 }));
+
+    std::vector<int> none;
+    EXPECT_EQ(from(none).chunk(3).count(), 0);
+    EXPECT_EQ(from(values).chunk(3).explain().find("chunk(3)"), 0);
+}
+
+TEST_F(LinqTest, TestScan) {
+    std::vector<int> values{ 3, 1, 4, 1, 5 };
+    auto plus = [](long long sum, const int& v) { return sum + v; };
+    EXPECT_EQ(from(values).scan(0LL, plus).toVector(), (std::vector<long long>{ 3, 4, 8, 9, 14 }));
+    EXPECT_EQ(from(values).exclusiveScan(0LL, plus).toVector(), (std::vector<long long>{ 0, 3, 4, 8, 9 }));
+    EXPECT_EQ(from(values).scan(100LL, plus).toVector().back(), 114);
+    auto highest = from(values).scan(0, [](int best, const int& v) { return std::max(best, v); });
+    EXPECT_EQ(highest.toVector(), (std::vector<int>{ 3, 3, 4, 4, 5 }));
+    // Lazy, later stages only pull what they need
+    EXPECT_EQ(from(values).scan(0LL, plus).filter([](const long long& v) { return v > 5; }).first(), 8);
+    std::vector<int> none;
+    EXPECT_EQ(from(none).scan(0LL, plus).count(), 0);
+    EXPECT_EQ(from(none).exclusiveScan(0LL, plus).count(), 0);
+    EXPECT_EQ(from(values).scan(0LL, plus).explain().find("scan(fn) [random_access, O(n)] est=5"), 0);
+}
+
+TEST_F(LinqTest, TestParallelScan) {
+    std::mt19937 random(11);
+    std::vector<int> ledger(100000);
+    for (int& v : ledger) v = static_cast<int>(random() % 2001) - 1000;
+    std::vector<long long> expected(ledger.size());
+    long long balance = 0;
+    for (size_t i = 0; i < ledger.size(); i++) expected[i] = balance += ledger[i];
+    auto plus = [](long long sum, const int& v) { return sum + v; };
+    auto combine = [](long long a, long long b) { return a + b; };
+
+    linq::thread_pool pool(4);
+    auto running = from(ledger).scan(linq::parallel_t{ 777 }.on(pool), 0LL, plus, combine);
+    EXPECT_EQ(running.toVector(), expected);
+    auto before = from(ledger).exclusiveScan(linq::parallel_t{ 1000 }.on(pool), 0LL, plus, combine).toVector();
+    EXPECT_EQ(before.front(), 0);
+    EXPECT_EQ(before.back(), expected[expected.size() - 2]);
+    EXPECT_EQ(running.explain().find("scan(par, fn)"), 0);
+    EXPECT_EQ(running.take(5).toVector(), std::vector<long long>(expected.begin(), expected.begin() + 5));
+    // Starts partway into a chunk, so the carry into that chunk still has to be picked up
+    EXPECT_EQ(running.skip(1000).take(3).toVector(), std::vector<long long>(expected.begin() + 1000, expected.begin() + 1003));
+
+    std::vector<int> none;
+    EXPECT_EQ(from(none).scan(linq::par.on(pool), 0LL, plus, combine).count(), 0);
+}
+
+TEST_F(LinqTest, TestSampleReservoir) {
+    std::vector<int> values(1000);
+    for (int i = 0; i < 1000; i++) values[i] = i;
+    std::vector<int> sample = from(values).sampleReservoir(10, 42).toVector();
+    EXPECT_EQ(sample.size(), 10);
+    EXPECT_EQ(std::set<int>(sample.begin(), sample.end()).size(), 10);
+    EXPECT_EQ(from(values).sampleReservoir(10, 42).toVector(), sample);
+    EXPECT_EQ(from(values).sampleReservoir(10, 42).take(5).toVector(), std::vector<int>(sample.begin(), sample.begin() + 5));
+    EXPECT_EQ(from(values).sampleReservoir(10, 42).skip(7).toVector(), std::vector<int>(sample.begin() + 7, sample.end()));
+    EXPECT_EQ(from(values).sampleReservoir(5000, 1).count(), 1000);
+    EXPECT_EQ(from(values).sampleReservoir(0, 1).count(), 0);
+
+    // Every row is about equally likely to be picked, whether or not the input knows its size
+    std::vector<int> small(20);
+    for (int i = 0; i < 20; i++) small[i] = i;
+    std::vector<int> picked(20, 0);
+    std::vector<int> pickedStepping(20, 0);
+    for (uint64_t seed = 0; seed < 4000; seed++) {
+        from(small).sampleReservoir(5, seed).forEach([&picked](const int& v) { picked[v]++; });
+        from(small).filter([](const int&) { return true; }).sampleReservoir(5, seed).forEach([&pickedStepping](const int& v) { pickedStepping[v]++; });
+    }
+    for (int i = 0; i < 20; i++) {
+        EXPECT_NEAR(picked[i], 1000, 150);
+        EXPECT_NEAR(pickedStepping[i], 1000, 150);
+    }
+    EXPECT_EQ(from(values).sampleReservoir(10, 42).explain().find("sampleReservoir(10) [random_access, materializes, O(n)] est<=10"), 0);
+}
+
+TEST_F(LinqTest, TestSampleBernoulli) {
+    std::vector<int> values(100000);
+    for (int i = 0; i < 100000; i++) values[i] = i;
+    std::vector<int> sample = from(values).sampleBernoulli(0.01, 7).toVector();
+    EXPECT_NEAR(static_cast<double>(sample.size()), 1000, 150);
+    EXPECT_TRUE(std::is_sorted(sample.begin(), sample.end()));
+    EXPECT_EQ(std::set<int>(sample.begin(), sample.end()).size(), sample.size());
+    EXPECT_EQ(from(values).sampleBernoulli(0.01, 7).toVector(), sample);
+    // Stepping through an input that can't jump gives the same rows
+    EXPECT_EQ(from(values).filter([](const int&) { return true; }).sampleBernoulli(0.01, 7).toVector(), sample);
+    EXPECT_EQ(from(values).sampleBernoulli(0, 7).count(), 0);
+    EXPECT_EQ(from(values).sampleBernoulli(1, 7).count(), 100000);
+    size_t odd = from(values).sampleBernoulli(0.5, 3).filter([](const int& v) { return v % 2 == 1; }).count();
+    EXPECT_NEAR(static_cast<double>(odd), 25000, 600);
+    std::vector<int> none;
+    EXPECT_EQ(from(none).sampleBernoulli(0.5, 1).count(), 0);
+    EXPECT_EQ(from(values).sampleBernoulli(0.25, 1).explain().find("sampleBernoulli(0.25)"), 0);
+}
+
+TEST_F(LinqTest, TestApproxCountDistinct) {
+    std::vector<int> values(300000);
+    for (int i = 0; i < 300000; i++) values[i] = (i * 37) % 100000;
+    EXPECT_NEAR(static_cast<double>(from(values).approxCountDistinct()), 100000, 3000);
+    EXPECT_NEAR(static_cast<double>(from(values).approxCountDistinct(10)), 100000, 12000);
+    // The same sketch whether the input is one array, stepped through, or split into chunks
+    EXPECT_EQ(from(values).filter([](const int&) { return true; }).toHyperLogLog(), from(values).toHyperLogLog());
+    linq::thread_pool pool(4);
+    EXPECT_EQ(from(values).toHyperLogLog(linq::parallel_t{ 10000 }.on(pool)), from(values).toHyperLogLog());
+    EXPECT_EQ(from(values).approxCountDistinct(linq::par.on(pool)), from(values).approxCountDistinct());
+
+    std::vector<int> few = { 3, 1, 3, 2, 1 };
+    EXPECT_EQ(from(few).approxCountDistinct(), 3);
+    std::vector<int> none;
+    EXPECT_EQ(from(none).approxCountDistinct(), 0);
+    EXPECT_TRUE(from(none).toHyperLogLog().empty());
+    EXPECT_THROW(from(few).approxCountDistinct(3), const char*);
+}
+
+TEST_F(LinqTest, TestHyperLogLog) {
+    std::vector<std::string> names(50000);
+    for (int i = 0; i < 50000; i++) names[i] = "user" + std::to_string(i);
+    linq::hyperloglog first;
+    first.add(names.begin(), names.begin() + 30000);
+    linq::hyperloglog second;
+    second.add(names.begin() + 20000, names.end());
+    linq::hyperloglog merged = first | second;
+    EXPECT_EQ(merged, from(names).toHyperLogLog());
+    EXPECT_NEAR(merged.estimate(), 50000, 1500);
+    EXPECT_EQ(merged.bytes(), 16384);
+    EXPECT_THROW(first |= linq::hyperloglog(12), const char*);
+
+    std::string bytes = merged.serialize();
+    EXPECT_EQ(bytes.size(), 2 + 16384);
+    EXPECT_EQ(linq::hyperloglog::deserialize(bytes), merged);
+    EXPECT_THROW(linq::hyperloglog::deserialize(bytes.substr(0, 100)), const char*);
+    bytes[2] = static_cast<char>(80);
+    EXPECT_THROW(linq::hyperloglog::deserialize(bytes), const char*);
+
+    // Sketches per group merge into the sketch for every group together
+    std::vector<int> visits(20000);
+    for (int i = 0; i < 20000; i++) visits[i] = i % 5000;
+    auto perDay = linq::incremental::group([](const int& v) { return v % 7; }, linq::hyperloglog(12), [](linq::hyperloglog sketch, const int& v) {
+        sketch.add(v);
+        return sketch;
+    });
+    for (int v : visits) perDay.add(v);
+    EXPECT_EQ(perDay.result().size(), 7);
+    linq::hyperloglog week(12);
+    for (const auto& day : perDay.result()) week |= day.second;
+    EXPECT_EQ(week, from(visits).toHyperLogLog(12));
+    EXPECT_NEAR(week.estimate(), 5000, 300);
+}
@@ -1,14 +1,28 @@
 #ifndef _UTIL_H_
 #define _UTIL_H_
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <variant>
+#include <vector>
 #include <type_traits>
 
-// Test whether two ordered ranges intersect at all
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LINQ_HAS_SSE2
+#endif
+
+// Advances whichever of two ordered ranges is behind until both point at equal values, false if one ran out first
 template<class InputIt1, class InputIt2>
-bool intersect(InputIt1 first1, InputIt1 last1, InputIt2 first2, InputIt2 last2) noexcept
+bool alignOrdered(InputIt1& first1, InputIt1 last1, InputIt2& first2, InputIt2 last2) noexcept
 {
 	while (first1 != last1 && first2 != last2) {
 		if (*first1 < *first2) {
@@ -24,6 +38,300 @@ bool intersect(InputIt1 first1, InputIt1 last1, InputIt2 first2, InputIt2 last2)
 	return false;
 }
 
+// Test whether two ordered ranges intersect at all
+template<class InputIt1, class InputIt2>
+bool intersect(InputIt1 first1, InputIt1 last1, InputIt2 first2, InputIt2 last2) noexcept
+{
+	return alignOrdered(first1, last1, first2, last2);
+}
+
+inline size_t popcount64(uint64_t word) noexcept {
+#if defined(_MSC_VER)
+	return static_cast<size_t>(__popcnt64(word));
+#else
+	return static_cast<size_t>(__builtin_popcountll(word));
+#endif
+}
+
+// Undefined for 0 like the intrinsics it wraps
+inline size_t countTrailingZeros64(uint64_t word) noexcept {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return static_cast<size_t>(index);
+#else
+	return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+}
+
+// Undefined for 0 like the intrinsics it wraps
+inline size_t countLeadingZeros64(uint64_t word) noexcept {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, word);
+	return static_cast<size_t>(63 - index);
+#else
+	return static_cast<size_t>(__builtin_clzll(word));
+#endif
+}
+
+// Kernels for set operations on ascending, duplicate free arrays of 32 or 64 bit integers, like posting lists.
+// Blocks of 16 bytes from each side are compared all against all with SSE2 where it's available, and when one side
+// is at least sortedGallopRatio times longer the shorter side's values are searched for in it by galloping instead.
+// Outputs have to hold min(na, nb) values for intersections, na for differences and na + nb for unions.
+namespace detail {
+	constexpr size_t sortedGallopRatio = 32;
+
+	template<typename T>
+	constexpr size_t sortedLanes = 16 / sizeof(T);
+
+	template<typename T>
+	constexpr void checkSortedKernelType() {
+		static_assert(std::is_integral_v<T> && (sizeof(T) == 4 || sizeof(T) == 8), "Sorted set kernels work on 32 and 64 bit integers");
+	}
+
+	// Bit i set when a[i] equals any value in b's block
+	template<typename T>
+	unsigned blockMatches(const T* a, const T* b) noexcept {
+#ifdef LINQ_HAS_SSE2
+		__m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+		__m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+		if constexpr (sizeof(T) == 4) {
+			__m128i matches = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi32(left, right), _mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(0, 3, 2, 1)))),
+				_mm_or_si128(_mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(1, 0, 3, 2))), _mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(2, 1, 0, 3)))));
+			return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(matches)));
+		}
+		else {
+			// SSE2 has no 64 bit compare, both 32 bit halves have to match
+			auto equal = [](__m128i x, __m128i y) {
+				__m128i halves = _mm_cmpeq_epi32(x, y);
+				return _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+			};
+			__m128i matches = _mm_or_si128(equal(left, right), equal(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(1, 0, 3, 2))));
+			return static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(matches)));
+		}
+#else
+		unsigned matches = 0;
+		for (size_t i = 0; i < sortedLanes<T>; i++) {
+			for (size_t j = 0; j < sortedLanes<T>; j++) {
+				if (a[i] == b[j]) matches |= 1u << i;
+			}
+		}
+		return matches;
+#endif
+	}
+
+	// First position from on where data[position] >= value, probing 1, 2, 4, ... ahead before searching between
+	template<typename T>
+	size_t gallop(const T* data, size_t from, size_t n, T value) noexcept {
+		size_t probe = from;
+		for (size_t step = 1; probe < n && data[probe] < value; step *= 2) {
+			from = probe + 1;
+			probe += step;
+		}
+		return static_cast<size_t>(std::lower_bound(data + from, data + std::min(probe, n), value) - data);
+	}
+
+	// Walks a in order calling visit(values, n, matched) for runs of at most sortedLanes values, bit i of matched
+	// set when values[i] is also in b
+	template<typename T, typename Visit>
+	void matchSorted(const T* a, size_t na, const T* b, size_t nb, Visit visit) {
+		constexpr size_t lanes = sortedLanes<T>;
+		size_t i = 0;
+		size_t j = 0;
+		if (na && nb / na >= sortedGallopRatio) {
+			for (; i < na; i++) {
+				j = gallop(b, j, nb, a[i]);
+				visit(a + i, 1, j < nb && b[j] == a[i] ? 1u : 0u);
+			}
+			return;
+		}
+		unsigned matched = 0;
+		while (i + lanes <= na && j + lanes <= nb) {
+			matched |= blockMatches(a + i, b + j);
+			T lastA = a[i + lanes - 1];
+			T lastB = b[j + lanes - 1];
+			if (lastA <= lastB) {
+				visit(a + i, lanes, matched);
+				i += lanes;
+				matched = 0;
+			}
+			if (lastB <= lastA) j += lanes;
+		}
+		// The block of a the loop stopped in may already have matches from blocks of b it passed
+		for (size_t k = 0; i < na; i++, k++) {
+			while (j < nb && b[j] < a[i]) j++;
+			bool found = (k < lanes && ((matched >> k) & 1)) || (j < nb && b[j] == a[i]);
+			visit(a + i, 1, found ? 1u : 0u);
+		}
+	}
+}
+
+template<typename T>
+size_t sortedIntersectionCount(const T* a, size_t na, const T* b, size_t nb) {
+	detail::checkSortedKernelType<T>();
+	if (na > nb) return sortedIntersectionCount(b, nb, a, na);
+	size_t count = 0;
+	detail::matchSorted(a, na, b, nb, [&count](const T*, size_t, unsigned matched) { count += popcount64(matched); });
+	return count;
+}
+
+// Returns how many values were written to out
+template<typename T>
+size_t sortedIntersection(const T* a, size_t na, const T* b, size_t nb, T* out) {
+	detail::checkSortedKernelType<T>();
+	if (na > nb) return sortedIntersection(b, nb, a, na, out);
+	T* written = out;
+	detail::matchSorted(a, na, b, nb, [&written](const T* values, size_t, unsigned matched) {
+		for (; matched; matched &= matched - 1) *written++ = values[countTrailingZeros64(matched)];
+	});
+	return static_cast<size_t>(written - out);
+}
+
+template<typename T>
+size_t sortedDifferenceCount(const T* a, size_t na, const T* b, size_t nb) {
+	return na - sortedIntersectionCount(a, na, b, nb);
+}
+
+// Values of a that aren't in b, returns how many were written to out
+template<typename T>
+size_t sortedDifference(const T* a, size_t na, const T* b, size_t nb, T* out) {
+	detail::checkSortedKernelType<T>();
+	T* written = out;
+	detail::matchSorted(a, na, b, nb, [&written](const T* values, size_t n, unsigned matched) {
+		for (unsigned missing = ~matched & ((1u << n) - 1); missing; missing &= missing - 1) *written++ = values[countTrailingZeros64(missing)];
+	});
+	return static_cast<size_t>(written - out);
+}
+
+template<typename T>
+size_t sortedUnionCount(const T* a, size_t na, const T* b, size_t nb) {
+	return na + nb - sortedIntersectionCount(a, na, b, nb);
+}
+
+// Returns how many values were written to out. Merging has no cheap SIMD form, the skewed case still gallops so
+// the runs of the longer side between values of the shorter one are copied in bulk.
+template<typename T>
+size_t sortedUnion(const T* a, size_t na, const T* b, size_t nb, T* out) {
+	detail::checkSortedKernelType<T>();
+	if (na > nb) return sortedUnion(b, nb, a, na, out);
+	T* written = out;
+	size_t j = 0;
+	if (na && nb / na >= detail::sortedGallopRatio) {
+		for (size_t i = 0; i < na; i++) {
+			size_t next = detail::gallop(b, j, nb, a[i]);
+			written = std::copy(b + j, b + next, written);
+			j = next;
+			*written++ = a[i];
+			if (j < nb && b[j] == a[i]) j++;
+		}
+		return static_cast<size_t>(std::copy(b + j, b + nb, written) - out);
+	}
+	size_t i = 0;
+	while (i < na && j < nb) {
+		if (a[i] < b[j]) *written++ = a[i++];
+		else if (b[j] < a[i]) *written++ = b[j++];
+		else {
+			*written++ = a[i++];
+			j++;
+		}
+	}
+	written = std::copy(a + i, a + na, written);
+	return static_cast<size_t>(std::copy(b + j, b + nb, written) - out);
+}
+
+// Open addressing hash set with linear probing over a power of two table, values live inline so inserting doesn't
+// allocate per element like std::unordered_set. Each slot keeps 7 bits of the hash next to it so most probes that
+// won't match are rejected without calling Equal. There is no erase.
+template<typename T, typename Hash = std::hash<T>, typename Equal = std::equal_to<T>>
+class flat_hash_set {
+public:
+	flat_hash_set() = default;
+
+	explicit flat_hash_set(size_t expected) {
+		this->reserve(expected);
+	}
+
+	// True if value wasn't in the set yet
+	bool insert(const T& value) {
+		if ((this->count + 1) * 4 > this->control.size() * 3) this->grow(std::max<size_t>(16, this->control.size() * 2));
+		size_t hash = this->mix(value);
+		size_t slot = this->find(value, hash);
+		if (this->control[slot]) return false;
+		this->control[slot] = tag(hash);
+		this->slots[slot] = value;
+		this->count++;
+		return true;
+	}
+
+	bool contains(const T& value) const {
+		if (this->control.empty()) return false;
+		return this->control[this->find(value, this->mix(value))] != 0;
+	}
+
+	void reserve(size_t expected) {
+		size_t capacity = 16;
+		while (capacity * 3 < expected * 4) capacity *= 2;
+		if (capacity > this->control.size()) this->grow(capacity);
+	}
+
+	size_t size() const noexcept {
+		return this->count;
+	}
+
+	bool empty() const noexcept {
+		return this->count == 0;
+	}
+
+	void clear() {
+		this->control.clear();
+		this->slots.clear();
+		this->count = 0;
+	}
+
+private:
+	std::vector<uint8_t> control;
+	std::vector<std::optional<T>> slots;
+	size_t count{ 0 };
+	Hash hasher;
+	Equal equal;
+
+	// std::hash is the identity for integers, spread the bits so strided keys don't pile up in one run of slots
+	size_t mix(const T& value) const {
+		uint64_t hash = static_cast<uint64_t>(this->hasher(value)) * 0x9E3779B97F4A7C15ull;
+		return static_cast<size_t>(hash ^ (hash >> 32));
+	}
+
+	static uint8_t tag(size_t hash) noexcept {
+		return static_cast<uint8_t>(0x80 | (hash >> 57));
+	}
+
+	// Slot holding value, or the empty slot it would go in
+	size_t find(const T& value, size_t hash) const {
+		size_t mask = this->control.size() - 1;
+		uint8_t wanted = tag(hash);
+		for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+			if (!this->control[slot]) return slot;
+			if (this->control[slot] == wanted && this->equal(*this->slots[slot], value)) return slot;
+		}
+	}
+
+	void grow(size_t capacity) {
+		std::vector<uint8_t> oldControl(capacity, 0);
+		std::vector<std::optional<T>> oldSlots(capacity);
+		oldControl.swap(this->control);
+		oldSlots.swap(this->slots);
+		for (size_t i = 0; i < oldControl.size(); i++) {
+			if (!oldControl[i]) continue;
+			size_t hash = this->mix(*oldSlots[i]);
+			size_t slot = this->find(*oldSlots[i], hash);
+			this->control[slot] = oldControl[i];
+			this->slots[slot] = std::move(oldSlots[i]);
+		}
+	}
+};
+
 template<class T, class U>
 U tryAtMap(const std::map<T, U>& map, const T& key, const U& def) noexcept {
 	auto iter = map.find(key);
@@ -215,7 +523,7 @@ template<template <typename...> typename Container, typename... Args,
 	std::ostream& operator<<(std::ostream& os, const Container<Args...>& t) {
 	os << "( ";
 	for (auto& val : t) {
-		std::cout << val << " ";
+		os << val << " ";
 	}
 	os << ")";
 	return os;